@@ -0,0 +1,187 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * @file awaitable.h
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing C++20 coroutine interface of engine.
+ *
+ * @detailed Header only, library itself is built as C++11. Include it
+ * from C++20 code:
+ *
+ *     Task handle(Engine& engine, cv::Mat image, Executor executor)
+ *     {
+ *         Recognizer::Result result = co_await recognize_async(
+ *                 engine, image, RequestContext::timeout(500), executor);
+ *         ...
+ *     }
+ */
+
+#ifndef AWAITABLE_H_
+#define AWAITABLE_H_
+
+#if __cplusplus < 202002L
+#error "awaitable.h requires C++20"
+#endif
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+#include "engine.h"
+
+namespace recognizer
+{
+
+/**
+ * @brief Executor resuming coroutine in the thread completing the job.
+ * @detailed Executor is any callable taking a nullary callable and
+ * running it on the executor, like posting to an event loop.
+ */
+struct InlineExecutor {
+    template <typename Function>
+    void operator()(Function&& function) const
+    {
+        std::forward<Function>(function)();
+    }
+};
+
+/**
+ * @brief Awaitable recognition of engine job.
+ *
+ * @detailed Coroutine suspends while job passes engine stages and is
+ * resumed through the executor when job is finished. Awaiter lives in
+ * the coroutine frame and the completion callback captures only the
+ * awaiter and the coroutine handle, so awaiting allocates nothing
+ * besides the job itself. Result is the same as of
+ * Engine::get_text_async: partial result marked expired on deadline or
+ * cancellation, RecException if job is shed, fails or engine is closed.
+ */
+
+template <typename Executor = InlineExecutor>
+class RecognizeAwaitable {
+public:
+    RecognizeAwaitable(Engine& engine, Engine::Job job, Executor executor)
+            : engine_(engine),
+              job_(std::move(job)),
+              executor_(std::move(executor)),
+              outcome_(),
+              closed_(false)
+    {}
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle)
+    {
+        job_.done = [this, handle](const Engine::Outcome& outcome) {
+            outcome_ = outcome;
+            executor_([handle] { handle.resume(); });
+        };
+
+        // Coroutine may be resumed before submit returns, so awaiter
+        // is not touched after it
+        if (engine_.submit(std::move(job_)) == Engine::Admission::closed) {
+            closed_ = true;
+            return false;
+        }
+
+        return true;
+    }
+
+    Recognizer::Result await_resume()
+    {
+        if (closed_) {
+            throw RecException("engine is closed");
+        }
+
+        if (!outcome_.error.empty() && !outcome_.result.expired) {
+            throw RecException(outcome_.error);
+        }
+
+        return std::move(outcome_.result);
+    }
+
+private:
+    Engine& engine_;
+    Engine::Job job_;
+    Executor executor_;
+    Engine::Outcome outcome_;
+    bool closed_;
+};
+
+/**
+ * @brief Await recognition of decoded image.
+ *
+ * @param[in] engine Engine running the job.
+ * @param[in] image Image, must not be modified until awaiting is done.
+ * @param[in] ctx Request deadline and cancel token.
+ * @param[in] executor Executor resuming coroutine.
+ * @param[in] priority Priority class of job.
+ */
+template <typename Executor = InlineExecutor>
+RecognizeAwaitable<Executor>
+recognize_async(Engine& engine, const cv::Mat& image,
+                const RequestContext& ctx = RequestContext(),
+                Executor executor = Executor(),
+                Priority priority = Priority::interactive)
+{
+    Engine::Job job(0, std::string(), ctx, priority);
+    job.image = image;
+
+    return RecognizeAwaitable<Executor>(engine, std::move(job),
+                                        std::move(executor));
+}
+
+/**
+ * @brief Await decoding and recognition of encoded image.
+ */
+template <typename Executor = InlineExecutor>
+RecognizeAwaitable<Executor>
+recognize_async(Engine& engine, std::vector<uchar> data,
+                const RequestContext& ctx = RequestContext(),
+                Executor executor = Executor(),
+                Priority priority = Priority::interactive)
+{
+    Engine::Job job(0, std::string(), ctx, priority);
+    job.data = std::move(data);
+
+    return RecognizeAwaitable<Executor>(engine, std::move(job),
+                                        std::move(executor));
+}
+
+/**
+ * @brief Await recognition of any engine job.
+ */
+template <typename Executor = InlineExecutor>
+RecognizeAwaitable<Executor>
+recognize_async(Engine& engine, Engine::Job job,
+                Executor executor = Executor())
+{
+    return RecognizeAwaitable<Executor>(engine, std::move(job),
+                                        std::move(executor));
+}
+
+}
+
+#endif // AWAITABLE_H_
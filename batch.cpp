@@ -0,0 +1,401 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * @file batch.cpp
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing batch mode helpers definition.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <numeric>
+#include <sstream>
+#include <thread>
+
+#include <dirent.h>
+#include <glob.h>
+#include <sys/stat.h>
+
+#include "batch.h"
+#include "imageheader.h"
+
+namespace recognizer
+{
+
+/**
+ * Collect image files from input specification.
+ */
+void
+Batch::collect(const std::string& spec, Files& files) REC_THROW(RecException)
+{
+    if (spec.empty()) {
+        throw RecException("empty input");
+    }
+
+    // Manifest file
+    if (spec[0] == '@') {
+        std::string manifest = spec.substr(1);
+        if (manifest == "-") {
+            read_manifest(std::cin, files);
+            return;
+        }
+
+        std::ifstream in(manifest);
+        if (!in) {
+            throw RecException("could not open manifest " + manifest);
+        }
+
+        read_manifest(in, files);
+        return;
+    }
+
+    struct stat st;
+    if (!::stat(spec.c_str(), &st)) {
+        if (S_ISDIR(st.st_mode)) {
+            Files found;
+            if (!scan_dir(spec, found)) {
+                throw RecException("could not open directory " + spec);
+            }
+            std::sort(found.begin(), found.end());
+            files.insert(files.end(), found.begin(), found.end());
+        } else {
+            files.push_back(spec);
+        }
+        return;
+    }
+
+    // Glob pattern, quoted by user to bypass shell limits on argument list
+    glob_t matches;
+    int rc = ::glob(spec.c_str(), 0, nullptr, &matches);
+    if (rc == GLOB_NOMATCH) {
+        ::globfree(&matches);
+        throw RecException("no such file or directory " + spec);
+    } else if (rc) {
+        ::globfree(&matches);
+        throw RecException("could not expand pattern " + spec);
+    }
+
+    for (std::size_t idx = 0; idx < matches.gl_pathc; ++idx) {
+        files.push_back(matches.gl_pathv[idx]);
+    }
+
+    ::globfree(&matches);
+}
+
+/**
+ * Read manifest stream with one path per line.
+ */
+void
+Batch::read_manifest(std::istream& in, Files& files)
+{
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line[line.length() - 1] == '\r') {
+            line.erase(line.length() - 1);
+        }
+
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        files.push_back(line);
+    }
+}
+
+/**
+ * Check file extension for known image formats.
+ */
+bool
+Batch::is_image(const std::string& file)
+{
+    static const char* const extensions[] = {
+        "jpg", "jpeg", "jpe", "png", "bmp", "dib", "tif", "tiff",
+        "pbm", "pgm", "ppm", "pnm", "webp", "jp2", "sr", "ras"
+    };
+
+    std::string::size_type dot = file.rfind('.');
+    if (dot == std::string::npos) {
+        return false;
+    }
+
+    std::string ext = file.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+
+    for (const char* e : extensions) {
+        if (ext == e) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Recursively collect image files from directory.
+ */
+bool
+Batch::scan_dir(const std::string& dir, Files& files)
+{
+    std::unique_ptr<DIR, int (*)(DIR*)> d(::opendir(dir.c_str()),
+                                          ::closedir);
+    if (!d) {
+        return false;
+    }
+
+    std::string prefix = dir;
+    if (prefix[prefix.length() - 1] != '/') {
+        prefix.push_back('/');
+    }
+
+    while (struct dirent* entry = ::readdir(d.get())) {
+        std::string name = entry->d_name;
+        if (name == "." || name == "..") {
+            continue;
+        }
+
+        std::string path = prefix + name;
+        struct stat st;
+        if (::lstat(path.c_str(), &st)) {
+            continue;
+        }
+
+        // Linked files are taken, linked directories may form cycles
+        if (S_ISLNK(st.st_mode) &&
+            (::stat(path.c_str(), &st) || S_ISDIR(st.st_mode))) {
+            continue;
+        }
+
+        // Unreadable subdirectory doesn't stop the batch
+        if (S_ISDIR(st.st_mode)) {
+            scan_dir(path, files);
+        } else if (S_ISREG(st.st_mode) && is_image(name)) {
+            files.push_back(path);
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Order files longest processing time first.
+ */
+Batch::Plan
+Batch::plan(const Files& files, std::size_t workers, std::size_t window)
+{
+    Plan plan(files.size());
+
+    // Header reads wait for the disk, they overlap on several threads
+    std::atomic<std::size_t> next(0);
+    auto estimate = [&files, &plan, &next]() {
+        for (std::size_t idx = next++; idx < files.size(); idx = next++) {
+            plan[idx].index = idx;
+
+            ImageHeader header = ImageHeader::read(files[idx]);
+            if (header.valid()) {
+                plan[idx].cost = static_cast<double>(header.size.width) *
+                        header.size.height;
+            }
+        }
+    };
+
+    std::vector<std::thread> readers;
+    for (std::size_t r = 1; r < std::min(workers, files.size()); ++r) {
+        readers.emplace_back(estimate);
+    }
+    estimate();
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+
+    double known = 0.0;
+    std::size_t known_count = 0;
+    for (const Planned& planned : plan) {
+        if (planned.cost > 0.0) {
+            known += planned.cost;
+            ++known_count;
+        }
+    }
+
+    double unknown_cost = known_count ? known / known_count : 1.0;
+    double total = 0.0;
+    for (Planned& planned : plan) {
+        if (planned.cost <= 0.0) {
+            planned.cost = unknown_cost;
+        }
+        total += planned.cost;
+    }
+
+    // Ideal makespan is at least the fair share of every worker
+    double share = workers ? total / workers : total;
+    for (Planned& planned : plan) {
+        planned.split = workers > 1 && planned.cost > share;
+    }
+
+    std::size_t step = window ? window : plan.size();
+    for (std::size_t begin = 0; begin < plan.size(); begin += step) {
+        std::size_t end = std::min(begin + step, plan.size());
+        std::stable_sort(plan.begin() + begin, plan.begin() + end,
+                         [](const Planned& a, const Planned& b) {
+                             return a.cost > b.cost;
+                         });
+    }
+
+    return plan;
+}
+
+/**
+ * Escape string for JSON output.
+ */
+std::string
+Batch::json_escape(const std::string& s)
+{
+    std::string out;
+    out.reserve(s.length() + 2);
+
+    for (char ch : s) {
+        switch (ch) {
+        case '"':  out.append("\\\""); break;
+        case '\\': out.append("\\\\"); break;
+        case '\n': out.append("\\n"); break;
+        case '\r': out.append("\\r"); break;
+        case '\t': out.append("\\t"); break;
+        default:
+            if (static_cast<unsigned char>(ch) < 0x20) {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\u%04x", ch);
+                out.append(buf);
+            } else {
+                out.push_back(ch);
+            }
+        }
+    }
+
+    return out;
+}
+
+/**
+ * Format job outcome as a single line JSON object.
+ */
+std::string
+Batch::to_json(const Engine::Outcome& outcome)
+{
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+
+    out << "{\"id\":" << outcome.id
+        << ",\"file\":\"" << json_escape(outcome.file) << '"'
+        << ",\"text\":\"" << json_escape(outcome.result.text) << '"'
+        << ",\"boxes\":[";
+
+    bool first = true;
+    for (const cv::Rect& r : outcome.result.boxes) {
+        out << (first ? "" : ",")
+            << '[' << r.x << ',' << r.y << ','
+            << r.width << ',' << r.height << ']';
+        first = false;
+    }
+
+    out << "],\"timings\":{"
+        << "\"load_ms\":" << outcome.load_ms
+        << ",\"decode_ms\":" << outcome.decode_ms
+        << ",\"detect_ms\":" << outcome.result.detect_ms
+        << ",\"ocr_ms\":" << outcome.result.ocr_ms
+        << ",\"total_ms\":" << outcome.total_ms
+        << "},\"expired\":" << (outcome.result.expired ? "true" : "false")
+        << ",\"degraded\":" << (outcome.degraded ? "true" : "false")
+        << ",\"coalesced\":" << (outcome.coalesced ? "true" : "false")
+        << ",\"priority\":\""
+        << (outcome.priority == Priority::background ?
+            "background" : "interactive") << '"'
+        << ",\"error\":";
+
+    if (outcome.error.empty()) {
+        out << "null";
+    } else {
+        out << '"' << json_escape(outcome.error) << '"';
+    }
+
+    out << '}';
+
+    return out.str();
+}
+
+/**
+ * Latency percentile.
+ */
+double
+LatencyStats::percentile(double p) const
+{
+    if (samples_.empty()) {
+        return 0.0;
+    }
+
+    // Nearest rank method
+    std::size_t n = samples_.size();
+    std::size_t rank = static_cast<std::size_t>(std::ceil(p / 100.0 * n));
+    rank = std::min(std::max(rank, static_cast<std::size_t>(1)), n);
+
+    std::nth_element(samples_.begin(), samples_.begin() + (rank - 1),
+                     samples_.end());
+
+    return samples_[rank - 1];
+}
+
+/**
+ * Mean latency in milliseconds.
+ */
+double
+LatencyStats::mean() const
+{
+    if (samples_.empty()) {
+        return 0.0;
+    }
+
+    return std::accumulate(samples_.begin(), samples_.end(), 0.0) /
+            samples_.size();
+}
+
+/**
+ * Print one line report with count and percentiles.
+ */
+void
+LatencyStats::report(std::ostream& out, const std::string& name) const
+{
+    std::ios::fmtflags flags = out.flags();
+
+    out << std::fixed << std::setprecision(2)
+        << name << ": n=" << count()
+        << " mean=" << mean()
+        << " p50=" << percentile(50.0)
+        << " p90=" << percentile(90.0)
+        << " p99=" << percentile(99.0)
+        << " max=" << percentile(100.0) << " ms" << std::endl;
+
+    out.flags(flags);
+}
+
+}
@@ -0,0 +1,175 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * @file batch.h
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing batch mode helpers declaration.
+ */
+
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "engine.h"
+#include "recexcept.h"
+
+namespace recognizer
+{
+
+/**
+ * @brief Class Batch provide helpers for batch mode: collecting input
+ * files and formatting results.
+ */
+
+class Batch {
+public:
+
+    typedef std::vector<std::string> Files;
+
+    /**
+     * @brief Planned position of input file in batch.
+     */
+    struct Planned {
+        // Index in collected files
+        std::size_t index = 0;
+        // Estimated cost in pixels
+        double cost = 0.0;
+        // Image exceeds fair share of one worker and should be split
+        bool split = false;
+    };
+
+    typedef std::vector<Planned> Plan;
+
+    /**
+     * @brief Collect image files from input specification.
+     * @detailed Input may be an image file, a directory (scanned
+     * recursively for image files), a glob pattern or a manifest
+     * file with one path per line prefixed by '@' ("@-" reads
+     * manifest from standard input).
+     *
+     * @param[in] spec Input specification.
+     * @param[out] files Collected file names.
+     * @throw RecException if input could not be read.
+     */
+    static void collect(const std::string& spec, Files& files)
+            REC_THROW(RecException);
+
+    /**
+     * @brief Read manifest stream with one path per line.
+     * @detailed Empty lines and lines started from '#' are skipped.
+     *
+     * @param[in] in Manifest stream.
+     * @param[out] files Collected file names.
+     */
+    static void read_manifest(std::istream& in, Files& files);
+
+    /**
+     * @brief Order files longest processing time first.
+     * @detailed Cost is estimated from image dimensions read from
+     * headers by a thread per worker, files without readable header get
+     * mean cost. Images costing more than the whole batch divided by
+     * workers can't be balanced by ordering and are marked for
+     * splitting. With a window files are sorted only within every
+     * window of input order, so no file is submitted much later than
+     * in input order.
+     *
+     * @param[in] files Collected file names.
+     * @param[in] workers Number of recognition threads.
+     * @param[in] window Number of files sorted together, 0 means all.
+     * @return Files in submission order.
+     */
+    static Plan plan(const Files& files, std::size_t workers,
+                     std::size_t window = 0);
+
+    /**
+     * @brief Format job outcome as a single line JSON object.
+     *
+     * @param[in] outcome Engine job outcome.
+     * @return JSON line without trailing newline.
+     */
+    static std::string to_json(const Engine::Outcome& outcome);
+
+    /**
+     * @brief Escape string for JSON output.
+     */
+    static std::string json_escape(const std::string& s);
+
+private:
+    static bool is_image(const std::string& file);
+    /**
+     * @brief Collect images of directory and its subdirectories.
+     * @detailed Symbolic links to directories are not followed,
+     * subdirectories which can't be opened are skipped.
+     *
+     * @return false if directory could not be opened.
+     */
+    static bool scan_dir(const std::string& dir, Files& files);
+};
+
+/**
+ * @brief Class LatencyStats collects latencies and reports percentiles.
+ */
+
+class LatencyStats {
+public:
+    LatencyStats()
+            : samples_()
+    {}
+
+    void add(double ms)
+    {
+        samples_.push_back(ms);
+    }
+
+    std::size_t count() const
+    {
+        return samples_.size();
+    }
+
+    /**
+     * @brief Latency percentile.
+     *
+     * @param[in] p Percentile in range [0, 100].
+     * @return Latency in milliseconds, zero if there are no samples.
+     */
+    double percentile(double p) const;
+
+    /**
+     * @brief Mean latency in milliseconds.
+     */
+    double mean() const;
+
+    /**
+     * @brief Print one line report with count and percentiles.
+     */
+    void report(std::ostream& out, const std::string& name) const;
+
+private:
+    mutable std::vector<double> samples_;
+};
+
+}
+
+#endif // BATCH_H_
@@ -0,0 +1,397 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * @file budget.cpp
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing thread budget definition.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include <sched.h>
+
+#include <opencv2/core.hpp>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "budget.h"
+#include "numa.h"
+
+namespace recognizer
+{
+
+namespace
+{
+
+/**
+ * CPUs allowed by cgroup v2 quota file, 0 if there is no limit.
+ */
+double
+cgroup2_cpus(const std::string& dir)
+{
+    std::ifstream max(dir + "/cpu.max");
+
+    std::string quota;
+    double period = 0.0;
+    if (!(max >> quota >> period) || quota == "max" || period <= 0.0) {
+        return 0.0;
+    }
+
+    return std::strtod(quota.c_str(), nullptr) / period;
+}
+
+/**
+ * CPUs allowed by cgroup CPU quota, 0 if there is no limit.
+ */
+double
+cgroup_cpus()
+{
+    // cgroup v2, own group first, then namespace root
+    std::ifstream self("/proc/self/cgroup");
+    std::string line;
+    while (std::getline(self, line)) {
+        if (line.compare(0, 3, "0::") == 0) {
+            double cpus = cgroup2_cpus("/sys/fs/cgroup" + line.substr(3));
+            if (cpus > 0.0) {
+                return cpus;
+            }
+        }
+    }
+
+    double cpus = cgroup2_cpus("/sys/fs/cgroup");
+    if (cpus > 0.0) {
+        return cpus;
+    }
+
+    // cgroup v1
+    std::ifstream quota("/sys/fs/cgroup/cpu/cpu.cfs_quota_us");
+    std::ifstream period("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+
+    long quota_us = 0, period_us = 0;
+    if (quota >> quota_us && period >> period_us &&
+        quota_us > 0 && period_us > 0) {
+        return static_cast<double>(quota_us) / period_us;
+    }
+
+    return 0.0;
+}
+
+}
+
+/**
+ * Create budget and its helper threads.
+ */
+ThreadBudget::ThreadBudget(std::size_t threads, std::size_t nodes)
+        : threads_(threads ? threads : available()),
+          mutex_(),
+          released_(),
+          busy_(0),
+          backlog_(0),
+          policy_(Policy::automatic),
+          tasks_(),
+          helpers_()
+{
+    // Any node may borrow all spare tokens, so each gets enough helpers
+    for (std::size_t node = 0; node < std::max<std::size_t>(nodes, 1);
+         ++node) {
+        tasks_.emplace_back(
+                std::unique_ptr<BlockingQueue<std::function<void()>>>(
+                        new BlockingQueue<std::function<void()>>(threads_)));
+    }
+
+    // Caller runs its share itself, so helpers cover the rest
+    for (std::size_t node = 0; node < tasks_.size(); ++node) {
+        for (std::size_t h = 1; h < threads_; ++h) {
+            helpers_.emplace_back(&ThreadBudget::helper_loop, this, node);
+        }
+    }
+}
+
+ThreadBudget::~ThreadBudget()
+{
+    for (const std::unique_ptr<BlockingQueue<std::function<void()>>>& tasks :
+             tasks_) {
+        tasks->close();
+    }
+    for (std::thread& helper : helpers_) {
+        helper.join();
+    }
+}
+
+/**
+ * Number of CPUs the process may use.
+ */
+std::size_t
+ThreadBudget::available()
+{
+    std::size_t cpus = std::thread::hardware_concurrency();
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (!::sched_getaffinity(0, sizeof(set), &set)) {
+        std::size_t allowed = static_cast<std::size_t>(CPU_COUNT(&set));
+        if (allowed && (!cpus || allowed < cpus)) {
+            cpus = allowed;
+        }
+    }
+
+    double quota = cgroup_cpus();
+    if (quota > 0.0) {
+        std::size_t allowed = static_cast<std::size_t>(std::ceil(quota));
+        if (allowed && (!cpus || allowed < cpus)) {
+            cpus = allowed;
+        }
+    }
+
+    return cpus ? cpus : 1;
+}
+
+/**
+ * Stop OpenCV and OpenMP from starting their own threads.
+ */
+void
+ThreadBudget::configure_libraries()
+{
+    // OpenCV loops run in the calling thread, which holds a token
+    cv::setNumThreads(0);
+
+    // Read by OpenMP runtime only if it hasn't started yet,
+    // explicit user setting wins
+    ::setenv("OMP_THREAD_LIMIT", "1", 0);
+
+    limit_thread();
+}
+
+/**
+ * Limit OpenMP regions started from the calling thread.
+ */
+void
+ThreadBudget::limit_thread()
+{
+#ifdef _OPENMP
+    omp_set_dynamic(1);
+    omp_set_num_threads(1);
+#endif
+}
+
+/**
+ * Number of tokens.
+ */
+std::size_t
+ThreadBudget::threads() const
+{
+    return threads_;
+}
+
+/**
+ * Take token for a job.
+ */
+void
+ThreadBudget::enter()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    released_.wait(lock, [this] { return busy_ < threads_; });
+    ++busy_;
+}
+
+/**
+ * Return token of a job.
+ */
+void
+ThreadBudget::leave()
+{
+    give_back(1);
+}
+
+/**
+ * Set number of jobs waiting for workers.
+ */
+void
+ThreadBudget::set_backlog(std::size_t backlog)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    backlog_ = backlog;
+}
+
+/**
+ * Set scheduling policy for spare tokens.
+ */
+void
+ThreadBudget::set_policy(Policy policy)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    policy_ = policy;
+}
+
+ThreadBudget::Policy
+ThreadBudget::policy() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return policy_;
+}
+
+/**
+ * Number of tokens a job may borrow now.
+ */
+std::size_t
+ThreadBudget::spare(bool split) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return free_tokens(split);
+}
+
+/**
+ * Tokens which may be borrowed under policy, called under lock.
+ */
+std::size_t
+ThreadBudget::free_tokens(bool split) const
+{
+    std::size_t reserved = busy_;
+    switch (policy_) {
+    case Policy::throughput:
+        return 0;
+    case Policy::automatic:
+        if (!split) {
+            reserved += backlog_;
+        }
+        break;
+    case Policy::latency:
+        break;
+    }
+
+    return reserved < threads_ ? threads_ - reserved : 0;
+}
+
+std::size_t
+ThreadBudget::borrow(std::size_t wanted, bool split)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::size_t tokens = std::min(wanted, free_tokens(split));
+    busy_ += tokens;
+
+    return tokens;
+}
+
+void
+ThreadBudget::give_back(std::size_t tokens)
+{
+    if (!tokens) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    busy_ -= tokens;
+    released_.notify_all();
+}
+
+/**
+ * Run body for indices on calling thread and spare threads.
+ */
+void
+ThreadBudget::parallel_for(std::size_t count, const Body& body, bool split)
+{
+    std::size_t tokens = count > 1 ? borrow(count - 1, split) : 0;
+
+    if (!tokens) {
+        for (std::size_t idx = 0; idx < count; ++idx) {
+            body(idx);
+        }
+        return;
+    }
+
+    // Shared by caller and helpers, lives until last of them is done
+    struct Loop {
+        std::atomic<std::size_t> next{0};
+        std::mutex mutex{};
+        std::condition_variable finished{};
+        std::size_t running = 0;
+        std::exception_ptr error{};
+    };
+
+    std::shared_ptr<Loop> loop = std::make_shared<Loop>();
+    loop->running = tokens + 1;
+
+    std::function<void()> run = [loop, count, &body] {
+        std::size_t idx;
+        while ((idx = loop->next.fetch_add(1)) < count) {
+            try {
+                body(idx);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(loop->mutex);
+                if (!loop->error) {
+                    loop->error = std::current_exception();
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(loop->mutex);
+        if (!--loop->running) {
+            loop->finished.notify_all();
+        }
+    };
+
+    // Helpers of the caller's node share its memory
+    std::size_t node = std::min(Numa::thread_node(), tasks_.size() - 1);
+    for (std::size_t t = 0; t < tokens; ++t) {
+        tasks_[node]->push(run);
+    }
+    run();
+
+    {
+        std::unique_lock<std::mutex> lock(loop->mutex);
+        loop->finished.wait(lock, [&loop] { return !loop->running; });
+    }
+
+    give_back(tokens);
+
+    if (loop->error) {
+        std::rethrow_exception(loop->error);
+    }
+}
+
+void
+ThreadBudget::helper_loop(std::size_t node)
+{
+    // Ocr pool and allocations follow the pinned node
+    if (tasks_.size() > 1) {
+        Numa::pin(node);
+    }
+    limit_thread();
+
+    std::function<void()> task;
+    while (tasks_[node]->pop(task)) {
+        task();
+        task = nullptr;
+    }
+}
+
+}
@@ -0,0 +1,213 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * @file budget.h
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing thread budget declaration.
+ */
+
+#ifndef BUDGET_H_
+#define BUDGET_H_
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+#include "queue.h"
+
+namespace recognizer
+{
+
+/**
+ * @brief Class ThreadBudget owns all threads recognition may run on.
+ *
+ * @detailed Budget is a number of thread tokens, by default the number
+ * of CPUs the process may use: hardware threads limited by affinity
+ * mask and cgroup CPU quota. Every running engine job holds one token.
+ * Tokens of idle workers which are not needed by queued jobs may be
+ * borrowed by a running job to process parts of its image in parallel
+ * on budget helper threads. So with a deep queue images are processed
+ * in parallel one per thread, with a shallow queue a single image gets
+ * the spare threads.
+ *
+ * Scheduling policy decides who gets spare tokens: in throughput mode
+ * nobody, every image runs serially on its worker; in latency mode the
+ * running jobs, even while other jobs are queued; in automatic mode
+ * the running jobs as long as queued jobs don't need them.
+ *
+ * OpenCV and OpenMP thread pools would otherwise each assume they own
+ * every core, so configure_libraries() makes OpenCV loops run in the
+ * calling thread and limit_thread() limits OpenMP regions of tesseract
+ * to the calling thread.
+ */
+
+class ThreadBudget {
+public:
+    typedef std::function<void(std::size_t)> Body;
+
+    /**
+     * @brief Scheduling policy for spare tokens.
+     */
+    enum class Policy {
+        automatic,
+        throughput,
+        latency
+    };
+
+    /**
+     * @brief Create budget and its helper threads.
+     * @detailed With several nodes every node gets its own helpers
+     * pinned to it, and parallel work runs on helpers of the node the
+     * calling thread is pinned to, so its buffers and ocr instances stay
+     * on the node.
+     *
+     * @param[in] threads Number of tokens, 0 means available().
+     * @param[in] nodes Number of NUMA nodes callers are pinned to, 1
+     * means helpers are not pinned.
+     */
+    explicit ThreadBudget(std::size_t threads = 0, std::size_t nodes = 1);
+
+    ThreadBudget(const ThreadBudget&) = delete;
+    ThreadBudget& operator=(const ThreadBudget&) = delete;
+
+    ~ThreadBudget();
+
+    /**
+     * @brief Number of CPUs the process may use.
+     * @detailed Minimum of hardware threads, CPUs in affinity mask and
+     * cgroup CPU quota rounded up, at least 1.
+     */
+    static std::size_t available();
+
+    /**
+     * @brief Stop OpenCV and OpenMP from starting their own threads.
+     * @detailed Changes state of the whole process: OpenCV thread count
+     * and OMP_THREAD_LIMIT environment variable, so other OpenCV and
+     * OpenMP users in the process run serially too. Called by engine
+     * only when asked in its options, or by application at startup.
+     */
+    static void configure_libraries();
+
+    /**
+     * @brief Limit OpenMP regions started from the calling thread to
+     * the calling thread.
+     */
+    static void limit_thread();
+
+    /**
+     * @brief Number of tokens.
+     */
+    std::size_t threads() const;
+
+    /**
+     * @brief Take token for a job, wait while all tokens are taken.
+     */
+    void enter();
+
+    /**
+     * @brief Return token of a job.
+     */
+    void leave();
+
+    /**
+     * @brief Token of a job held while the guard is alive.
+     */
+    class Token {
+    public:
+        explicit Token(ThreadBudget& budget)
+                : budget_(budget)
+        {
+            budget_.enter();
+        }
+
+        Token(const Token&) = delete;
+        Token& operator=(const Token&) = delete;
+
+        ~Token()
+        {
+            budget_.leave();
+        }
+
+    private:
+        ThreadBudget& budget_;
+    };
+
+    /**
+     * @brief Set number of jobs waiting for workers.
+     * @detailed Tokens reserved for waiting jobs are not borrowed.
+     */
+    void set_backlog(std::size_t backlog);
+
+    /**
+     * @brief Set scheduling policy for spare tokens.
+     */
+    void set_policy(Policy policy);
+
+    Policy policy() const;
+
+    /**
+     * @brief Number of tokens a job may borrow now.
+     *
+     * @param[in] split Job may take tokens reserved for queued jobs.
+     */
+    std::size_t spare(bool split = false) const;
+
+    /**
+     * @brief Run body for indices [0, count) on calling thread and
+     * spare threads.
+     * @detailed Without spare tokens body runs in the calling thread
+     * one index after another. First exception thrown by body is
+     * rethrown after all indices are done.
+     *
+     * @param[in] count Number of indices.
+     * @param[in] body Called once for every index.
+     * @param[in] split Job may take tokens reserved for queued jobs.
+     */
+    void parallel_for(std::size_t count, const Body& body,
+                      bool split = false);
+
+private:
+    std::size_t free_tokens(bool split) const;
+    std::size_t borrow(std::size_t wanted, bool split);
+    void give_back(std::size_t tokens);
+    void helper_loop(std::size_t node);
+
+private:
+    const std::size_t threads_;
+    mutable std::mutex mutex_;
+    std::condition_variable released_;
+    std::size_t busy_;
+    std::size_t backlog_;
+    Policy policy_;
+    // Tasks of helpers of every node
+    std::vector<std::unique_ptr<BlockingQueue<std::function<void()>>>>
+            tasks_;
+    std::vector<std::thread> helpers_;
+};
+
+}
+
+#endif // BUDGET_H_
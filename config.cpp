@@ -0,0 +1,102 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * @file config.cpp
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing recognizer presets definition.
+ */
+
+#include "config.h"
+
+namespace recognizer
+{
+
+/**
+ * Low latency preset.
+ */
+Config
+Config::fast()
+{
+    Config config;
+    config.name = "fast";
+    config.channels = Channels::luminance;
+    config.detection_scale = 0.5;
+    config.threshold_delta = 24;
+    config.min_probability = 0.3f;
+    config.grouping = Grouping::horizontal;
+
+    return config;
+}
+
+/**
+ * Default preset.
+ */
+Config
+Config::balanced()
+{
+    return Config();
+}
+
+/**
+ * High recall preset.
+ */
+Config
+Config::accurate()
+{
+    Config config;
+    config.name = "accurate";
+    config.threshold_delta = 8;
+    config.min_area = 0.00008f;
+    config.min_probability = 0.15f;
+    config.nm2_min_probability = 0.4f;
+    config.grouping_min_probability = 0.4f;
+    config.ocr_engine = OcrEngine::lstm;
+
+    return config;
+}
+
+/**
+ * Find preset by name.
+ */
+Config
+Config::preset(const std::string& name) REC_THROW(RecException)
+{
+    if (name == "fast") {
+        return fast();
+    } else if (name == "balanced") {
+        return balanced();
+    } else if (name == "accurate") {
+        return accurate();
+    }
+
+    throw RecException("unknown preset " + name);
+}
+
+/**
+ * Names of all presets.
+ */
+std::vector<std::string>
+Config::presets()
+{
+    return std::vector<std::string>{"fast", "balanced", "accurate"};
+}
+
+}
@@ -0,0 +1,164 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * @file config.h
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing recognizer tuning parameters and presets.
+ */
+
+#ifndef CONFIG_H_
+#define CONFIG_H_
+
+#include <string>
+#include <vector>
+
+#include "recexcept.h"
+
+/**
+ * Classifier path selecting the model compiled into the binary.
+ */
+#define RECOGNIZER_EMBEDDED_MODEL ":embedded:"
+
+namespace recognizer
+{
+
+/**
+ * @brief Detection, ocr and model settings of a recognizer.
+ * @detailed Default constructed config is the balanced preset, which
+ * matches parameters recognizer always used. Fast preset trades
+ * accuracy for throughput, accurate preset does the opposite. Presets
+ * don't change classifier files.
+ */
+
+struct Config {
+
+    /**
+     * @brief Set of channels passed to ER filters.
+     */
+    enum class Channels {
+        // Lightness channel and its inversion
+        luminance,
+        // R, G, B, lightness and gradient channels
+        all,
+        // All channels and inversions of all but gradient
+        all_inverted
+    };
+
+    /**
+     * @brief Character groups orientation.
+     */
+    enum class Grouping {
+        // Horizontal text lines, exhaustive search without classifier
+        horizontal,
+        // Any orientation, uses grouping classifier
+        any
+    };
+
+    /**
+     * @brief Tesseract engine mode.
+     */
+    enum class OcrEngine {
+        // Legacy engine, requires legacy traineddata
+        legacy,
+        // LSTM engine
+        lstm,
+        // Legacy and LSTM engines combined
+        combined,
+        // Whatever traineddata supports
+        automatic
+    };
+
+    std::string name = "balanced";
+
+    Channels channels = Channels::all_inverted;
+
+    // Detection runs on image scaled by this factor, boxes are mapped
+    // back and ocr reads the source image
+    double detection_scale = 1.0;
+
+    // Stage 1 ER filter parameters
+    int threshold_delta = 16;
+    float min_area = 0.00015f;
+    float max_area = 0.13f;
+    float min_probability = 0.2f;
+    bool non_max_suppression = true;
+    float min_probability_diff = 0.1f;
+
+    // Stage 2 ER filter parameters
+    float nm2_min_probability = 0.5f;
+
+    Grouping grouping = Grouping::any;
+    float grouping_min_probability = 0.5f;
+
+    OcrEngine ocr_engine = OcrEngine::automatic;
+    std::string ocr_language = "eng";
+    // Traineddata of ocr language mapped once and passed to every init,
+    // empty means tesseract reads it from its data path on every init
+    std::string tessdata_file{};
+
+    // Classifier files, relative names are searched from working
+    // directory, RECOGNIZER_EMBEDDED_MODEL selects built in model
+#ifdef RECOGNIZER_EMBED_MODELS
+    std::string classifier_nm1 = RECOGNIZER_EMBEDDED_MODEL;
+    std::string classifier_nm2 = RECOGNIZER_EMBEDDED_MODEL;
+    std::string classifier_grouping = RECOGNIZER_EMBEDDED_MODEL;
+#else
+    std::string classifier_nm1 = "trained_classifierNM1.xml";
+    std::string classifier_nm2 = "trained_classifierNM2.xml";
+    std::string classifier_grouping = "trained_classifier_erGrouping.xml";
+#endif
+
+    /**
+     * @brief Low latency preset: lightness channels only, half scale
+     * detection and horizontal grouping. Ocr engine is whatever the
+     * traineddata supports, so the preset works with LSTM only files.
+     */
+    static Config fast();
+
+    /**
+     * @brief Default preset.
+     */
+    static Config balanced();
+
+    /**
+     * @brief High recall preset: finer thresholds and lower
+     * probabilities, lstm ocr engine.
+     */
+    static Config accurate();
+
+    /**
+     * @brief Find preset by name.
+     *
+     * @param[in] name Name of preset: fast, balanced or accurate.
+     * @return Preset config.
+     * @throw RecException if there is no such preset.
+     */
+    static Config preset(const std::string& name) REC_THROW(RecException);
+
+    /**
+     * @brief Names of all presets.
+     */
+    static std::vector<std::string> presets();
+};
+
+}
+
+#endif // CONFIG_H_
@@ -0,0 +1,196 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * @file context.h
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing request deadline and cancellation types.
+ */
+
+#ifndef CONTEXT_H_
+#define CONTEXT_H_
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+namespace recognizer
+{
+
+class ThreadBudget;
+
+/**
+ * @brief Shared cancellation flag.
+ * @detailed Copies of token share the same flag, so the caller keeps
+ * one copy and passes another one with the request.
+ */
+
+class CancelToken {
+public:
+    CancelToken()
+            : flag_(std::make_shared<std::atomic<bool>>(false))
+    {}
+
+    void cancel() const noexcept
+    {
+        flag_->store(true, std::memory_order_relaxed);
+    }
+
+    bool cancelled() const noexcept
+    {
+        return flag_->load(std::memory_order_relaxed);
+    }
+
+private:
+    std::shared_ptr<std::atomic<bool>> flag_;
+};
+
+/**
+ * @brief Per-request deadline and cancel token.
+ * @detailed Recognizer checks context between channels, between
+ * ocr areas and inside tesseract. Expired request stops processing
+ * and returns what has been recognized so far.
+ */
+
+class RequestContext {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    /**
+     * @brief Context without deadline.
+     */
+    RequestContext()
+            : deadline_(Clock::time_point::max()),
+              token_(),
+              budget_(),
+              split_(false)
+    {}
+
+    /**
+     * @brief Context with deadline after timeout from now.
+     *
+     * @param[in] timeout_ms Timeout in milliseconds, 0 means no deadline.
+     * @return New context.
+     */
+    static RequestContext timeout(long timeout_ms)
+    {
+        RequestContext ctx;
+        if (timeout_ms > 0) {
+            ctx.deadline_ = Clock::now() +
+                    std::chrono::milliseconds(timeout_ms);
+        }
+
+        return ctx;
+    }
+
+    void set_deadline(const Clock::time_point& deadline) noexcept
+    {
+        deadline_ = deadline;
+    }
+
+    const Clock::time_point& deadline() const noexcept
+    {
+        return deadline_;
+    }
+
+    bool has_deadline() const noexcept
+    {
+        return deadline_ != Clock::time_point::max();
+    }
+
+    void set_token(const CancelToken& token)
+    {
+        token_ = token;
+    }
+
+    const CancelToken& token() const noexcept
+    {
+        return token_;
+    }
+
+    /**
+     * @brief Check whether request has been cancelled or deadline passed.
+     */
+    bool expired() const noexcept
+    {
+        return token_.cancelled() ||
+                (has_deadline() && Clock::now() >= deadline_);
+    }
+
+    /**
+     * @brief Milliseconds left until deadline.
+     *
+     * @return Remaining time, zero if expired, -1 if there is no deadline.
+     */
+    long remaining_ms() const noexcept
+    {
+        if (!has_deadline()) {
+            return -1;
+        }
+
+        Clock::time_point now = Clock::now();
+        if (now >= deadline_) {
+            return 0;
+        }
+
+        return static_cast<long>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline_ - now).count());
+    }
+
+    /**
+     * @brief Threads request may borrow for parallel parts of
+     * recognition, null means request runs in the calling thread only.
+     */
+    void set_budget(const std::shared_ptr<ThreadBudget>& budget)
+    {
+        budget_ = budget;
+    }
+
+    const std::shared_ptr<ThreadBudget>& budget() const noexcept
+    {
+        return budget_;
+    }
+
+    /**
+     * @brief Let request borrow threads reserved for queued requests.
+     * @detailed Set for images too large to balance between workers,
+     * so they are split between threads even under load.
+     */
+    void set_split(bool split) noexcept
+    {
+        split_ = split;
+    }
+
+    bool split() const noexcept
+    {
+        return split_;
+    }
+
+private:
+    Clock::time_point deadline_;
+    CancelToken token_;
+    std::shared_ptr<ThreadBudget> budget_;
+    bool split_;
+};
+
+}
+
+#endif // CONTEXT_H_
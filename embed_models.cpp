@@ -0,0 +1,244 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * @file embed_models.cpp
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing build tool converting classifiers to C++ tables.
+ *
+ * Usage: embed_models NM1.xml NM2.xml grouping.xml output.h
+ *
+ * Stage 1 and stage 2 classifiers are boosted decision stumps, they are
+ * parsed here into arrays of splits and leaf values. Grouping classifier
+ * is consumed by OpenCV erGrouping only as a file, so its text is
+ * embedded as is.
+ */
+
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+/**
+ * Decision stump: sample[var] <= threshold ? left : right.
+ */
+struct Stump {
+    int var = -1;
+    std::string threshold{};
+    std::string left{};
+    std::string right{};
+};
+
+bool read_file(const std::string& file, std::string& data)
+{
+    std::ifstream in(file, std::ios::in | std::ios::binary);
+    if (!in) {
+        return false;
+    }
+
+    std::ostringstream ss;
+    ss << in.rdbuf();
+    data = ss.str();
+
+    return true;
+}
+
+/**
+ * Find next element without children, return its tag and text.
+ */
+bool next_element(const std::string& xml, std::string::size_type& pos,
+                  std::string& tag, std::string& text)
+{
+    for (;;) {
+        std::string::size_type open = xml.find('<', pos);
+        if (open == std::string::npos) {
+            return false;
+        }
+
+        std::string::size_type close = xml.find('>', open);
+        if (close == std::string::npos) {
+            return false;
+        }
+
+        pos = close + 1;
+
+        if (xml[open + 1] == '/' || xml[open + 1] == '?') {
+            continue;
+        }
+
+        tag = xml.substr(open + 1, close - open - 1);
+        std::string::size_type end = xml.find('<', pos);
+        if (end == std::string::npos) {
+            return false;
+        }
+
+        // Element with children
+        if (xml.compare(end, tag.length() + 3, "</" + tag + ">")) {
+            continue;
+        }
+
+        std::string::size_type first = xml.find_first_not_of(" \t\r\n", pos);
+        std::string::size_type last = xml.find_last_not_of(" \t\r\n",
+                                                           end - 1);
+        text = (first < end) ? xml.substr(first, last - first + 1) : "";
+        pos = end + tag.length() + 3;
+
+        return true;
+    }
+}
+
+/**
+ * Parse boosted stumps of OpenCV ml boost file.
+ */
+bool parse_stumps(const std::string& file, std::vector<Stump>& stumps,
+                  int& var_count)
+{
+    std::string xml;
+    if (!read_file(file, xml)) {
+        std::cerr << "could not read " << file << std::endl;
+        return false;
+    }
+
+    std::string::size_type pos = 0;
+    std::string tag, text;
+
+    // Node values in depth-first order: root, left leaf, right leaf
+    int node = -1;
+    Stump stump;
+    bool inversed = false;
+    var_count = 0;
+
+    while (next_element(xml, pos, tag, text)) {
+        if (tag == "var_count") {
+            var_count = std::atoi(text.c_str());
+        } else if (tag == "max_depth" && text != "1") {
+            std::cerr << file << ": only stumps are supported" << std::endl;
+            return false;
+        } else if (tag == "depth") {
+            node = (text == "0") ? 0 : node + 1;
+            if (node > 2) {
+                std::cerr << file << ": unexpected tree node" << std::endl;
+                return false;
+            }
+        } else if (tag == "value" && node == 1) {
+            stump.left = text;
+        } else if (tag == "value" && node == 2) {
+            stump.right = text;
+            if (inversed) {
+                std::swap(stump.left, stump.right);
+            }
+            stumps.push_back(stump);
+            stump = Stump();
+            inversed = false;
+        } else if (tag == "var" && node == 0) {
+            stump.var = std::atoi(text.c_str());
+        } else if ((tag == "le" || tag == "gt") && node == 0) {
+            stump.threshold = text;
+            inversed = (tag == "gt");
+        }
+    }
+
+    if (stumps.empty() || !var_count) {
+        std::cerr << file << ": no trees found" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void write_stumps(std::ostream& out, const std::string& name,
+                  const std::vector<Stump>& stumps, int var_count)
+{
+    out << "const int " << name << "_vars = " << var_count << ";\n"
+        << "const std::size_t " << name << "_count = "
+        << stumps.size() << ";\n"
+        << "const Stump " << name << "_stumps[] = {\n";
+
+    for (const Stump& s : stumps) {
+        out << "    {" << s.var << ", " << s.threshold << ", "
+            << s.left << ", " << s.right << "},\n";
+    }
+
+    out << "};\n\n";
+}
+
+void write_text(std::ostream& out, const std::string& name,
+                const std::string& text)
+{
+    out << "const std::size_t " << name << "_size = "
+        << text.size() << ";\n"
+        << "const char " << name << "[] = {";
+
+    for (std::size_t idx = 0; idx < text.size(); ++idx) {
+        out << (idx % 16 ? " " : "\n    ")
+            << static_cast<int>(static_cast<signed char>(text[idx])) << ',';
+    }
+
+    out << "\n    0\n};\n\n";
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 5) {
+        std::cerr << "Usage: " << argv[0]
+                  << " NM1.xml NM2.xml grouping.xml output.h" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<Stump> nm1, nm2;
+    int nm1_vars, nm2_vars;
+    std::string grouping;
+
+    if (!parse_stumps(argv[1], nm1, nm1_vars) ||
+        !parse_stumps(argv[2], nm2, nm2_vars)) {
+        return EXIT_FAILURE;
+    }
+
+    if (!read_file(argv[3], grouping)) {
+        std::cerr << "could not read " << argv[3] << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::ofstream out(argv[4]);
+    if (!out) {
+        std::cerr << "could not write " << argv[4] << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    out << "// Generated by embed_models from classifier files, "
+        << "do not edit.\n\n"
+        << "namespace recognizer\n{\nnamespace embedded\n{\n\n";
+
+    write_stumps(out, "nm1", nm1, nm1_vars);
+    write_stumps(out, "nm2", nm2, nm2_vars);
+    write_text(out, "grouping_xml", grouping);
+
+    out << "}\n}\n";
+
+    return out ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,176 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * @file embedded_models.cpp
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing classifiers compiled into the binary.
+ */
+
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "embedded_models.h"
+
+#ifdef RECOGNIZER_EMBED_MODELS
+// Generated at build time by embed_models
+#include "embedded_models_data.h"
+#endif
+
+namespace recognizer
+{
+
+/**
+ * Evaluate stumps over region features.
+ */
+double
+StumpClassifier::eval(const cv::text::ERStat& stat)
+{
+    // Features in the order of stage 1 (first four) and stage 2 classifiers
+    const float sample[] = {
+        static_cast<float>(stat.rect.width) / stat.rect.height,
+        std::sqrt(static_cast<float>(stat.area)) / stat.perimeter,
+        static_cast<float>(1 - stat.euler),
+        stat.med_crossings,
+        stat.hole_area_ratio,
+        stat.convex_hull_ratio,
+        stat.num_inflexion_points
+    };
+
+    float votes = 0.0f;
+    for (std::size_t idx = 0; idx < count_; ++idx) {
+        const Stump& stump = stumps_[idx];
+        if (stump.var < 0 || stump.var >= vars_) {
+            continue;
+        }
+
+        votes += sample[stump.var] <= stump.threshold ?
+                stump.left : stump.right;
+    }
+
+    // Logistic correction to probability
+    return 1.0 - 1.0 / (1.0 + std::exp(-2.0 * votes));
+}
+
+#ifdef RECOGNIZER_EMBED_MODELS
+
+bool
+EmbeddedModels::available()
+{
+    return true;
+}
+
+/**
+ * Embedded stage 1 classifier.
+ */
+cv::Ptr<cv::text::ERFilter::Callback>
+EmbeddedModels::classifier_nm1() REC_THROW(RecException)
+{
+    static_assert(embedded::nm1_vars <= 7, "unexpected stage 1 features");
+
+    return cv::makePtr<StumpClassifier>(embedded::nm1_stumps,
+                                        embedded::nm1_count,
+                                        embedded::nm1_vars);
+}
+
+/**
+ * Embedded stage 2 classifier.
+ */
+cv::Ptr<cv::text::ERFilter::Callback>
+EmbeddedModels::classifier_nm2() REC_THROW(RecException)
+{
+    static_assert(embedded::nm2_vars <= 7, "unexpected stage 2 features");
+
+    return cv::makePtr<StumpClassifier>(embedded::nm2_stumps,
+                                        embedded::nm2_count,
+                                        embedded::nm2_vars);
+}
+
+/**
+ * Path of in-memory file with embedded grouping classifier.
+ */
+std::string
+EmbeddedModels::grouping_file() REC_THROW(RecException)
+{
+    // Created once and kept open for the process lifetime
+    static const int fd = [] {
+        int file = ::memfd_create("trained_classifier_erGrouping.xml", 0);
+        if (file < 0) {
+            return -1;
+        }
+
+        const char* data = embedded::grouping_xml;
+        std::size_t left = embedded::grouping_xml_size;
+        while (left) {
+            ssize_t written = ::write(file, data, left);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                ::close(file);
+                return -1;
+            }
+            data += written;
+            left -= static_cast<std::size_t>(written);
+        }
+
+        return file;
+    }();
+
+    if (fd < 0) {
+        throw RecException("could not create embedded grouping classifier");
+    }
+
+    return "/proc/self/fd/" + std::to_string(fd);
+}
+
+#else
+
+bool
+EmbeddedModels::available()
+{
+    return false;
+}
+
+cv::Ptr<cv::text::ERFilter::Callback>
+EmbeddedModels::classifier_nm1() REC_THROW(RecException)
+{
+    throw RecException("recognizer built without embedded models");
+}
+
+cv::Ptr<cv::text::ERFilter::Callback>
+EmbeddedModels::classifier_nm2() REC_THROW(RecException)
+{
+    throw RecException("recognizer built without embedded models");
+}
+
+std::string
+EmbeddedModels::grouping_file() REC_THROW(RecException)
+{
+    throw RecException("recognizer built without embedded models");
+}
+
+#endif
+
+}
@@ -0,0 +1,118 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * @file embedded_models.h
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing classifiers compiled into the binary.
+ */
+
+#ifndef EMBEDDED_MODELS_H_
+#define EMBEDDED_MODELS_H_
+
+#include <cstddef>
+#include <string>
+
+#include <opencv2/core.hpp>
+#include <opencv2/text.hpp>
+
+#include "recexcept.h"
+
+namespace recognizer
+{
+
+/**
+ * @brief Decision stump of boosted classifier.
+ * @detailed Vote is left if sample[var] <= threshold, right otherwise.
+ */
+struct Stump {
+    int var;
+    float threshold;
+    float left;
+    float right;
+};
+
+/**
+ * @brief ER classifier evaluating boosted stumps from constant tables.
+ * @detailed Computes the same features and logistic correction as
+ * OpenCV stage 1 and stage 2 classifiers without loading a file.
+ * Evaluation has no state, so one instance is shared by all filters.
+ */
+
+class StumpClassifier : public cv::text::ERFilter::Callback {
+public:
+    StumpClassifier(const Stump* stumps, std::size_t count, int vars)
+            : stumps_(stumps), count_(count), vars_(vars)
+    {}
+
+    StumpClassifier(const StumpClassifier&) = delete;
+    StumpClassifier& operator=(const StumpClassifier&) = delete;
+
+    double eval(const cv::text::ERStat& stat) override;
+
+private:
+    const Stump* stumps_;
+    const std::size_t count_;
+    const int vars_;
+};
+
+/**
+ * @brief Class EmbeddedModels provide classifiers built into binary
+ * with RECOGNIZER_EMBED_MODELS option.
+ *
+ * @detailed Stage 1 and stage 2 classifiers are stump tables parsed at
+ * build time, so no file is read or parsed at startup. OpenCV reads the
+ * grouping classifier only from a file, so its embedded text is served
+ * from an anonymous memory file.
+ */
+
+class EmbeddedModels {
+public:
+
+    /**
+     * @brief Check whether binary has been built with embedded models.
+     */
+    static bool available();
+
+    /**
+     * @brief Embedded stage 1 classifier.
+     * @throw RecException if models are not embedded.
+     */
+    static cv::Ptr<cv::text::ERFilter::Callback> classifier_nm1()
+            REC_THROW(RecException);
+
+    /**
+     * @brief Embedded stage 2 classifier.
+     * @throw RecException if models are not embedded.
+     */
+    static cv::Ptr<cv::text::ERFilter::Callback> classifier_nm2()
+            REC_THROW(RecException);
+
+    /**
+     * @brief Path of in-memory file with embedded grouping classifier.
+     * @throw RecException if models are not embedded or memory file
+     * could not be created.
+     */
+    static std::string grouping_file() REC_THROW(RecException);
+};
+
+}
+
+#endif // EMBEDDED_MODELS_H_
@@ -0,0 +1,955 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * @file engine.cpp
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing batch recognition engine definition.
+ */
+
+#include <algorithm>
+#include <utility>
+
+#include <opencv2/imgcodecs.hpp>
+
+#include "engine.h"
+
+namespace recognizer
+{
+
+namespace
+{
+
+/**
+ * Fill in defaults of engine settings.
+ */
+Engine::Options
+normalize(Engine::Options options)
+{
+    if (!options.threads) {
+        options.threads = ThreadBudget::available();
+    }
+    if (!options.workers) {
+        options.workers = options.threads;
+    }
+    if (!options.read_ahead) {
+        options.read_ahead = 2 * options.workers;
+    }
+    if (!options.io_depth) {
+        options.io_depth = options.read_ahead;
+    }
+    if (!options.decoders) {
+        options.decoders = std::max<std::size_t>(options.workers / 4, 1);
+    }
+    if (!options.decode_ahead) {
+        options.decode_ahead = options.workers;
+    }
+
+    return options;
+}
+
+/**
+ * Number of NUMA nodes threads of normalized settings are pinned to.
+ */
+std::size_t
+node_count(const Engine::Options& options)
+{
+    // Every node used needs at least one worker
+    return options.numa ? std::min(Numa::count(), options.workers) : 1;
+}
+
+Engine::Options
+make_options(std::size_t workers, std::size_t read_ahead)
+{
+    Engine::Options options;
+    options.workers = workers;
+    options.read_ahead = read_ahead;
+
+    return options;
+}
+
+// Weight of the last job in mean service time
+const double service_weight = 0.1;
+
+/**
+ * FNV-1a hash of bytes continuing from the given hash.
+ */
+std::uint64_t
+fnv1a(const uchar* data, std::size_t size,
+      std::uint64_t hash = 14695981039346656037ULL)
+{
+    for (std::size_t idx = 0; idx < size; ++idx) {
+        hash ^= data[idx];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+}
+
+/**
+ * Start engine threads.
+ */
+Engine::Engine(std::size_t workers, std::size_t read_ahead, Callback callback)
+        REC_THROW(RecException)
+        : Engine(make_options(workers, read_ahead), std::move(callback))
+{}
+
+/**
+ * Start engine threads.
+ */
+Engine::Engine(const Options& options, Callback callback)
+        REC_THROW(RecException)
+        : options_(normalize(options)),
+          recognizer_(Recognizer::create(options_.config)),
+          degraded_recognizer_(Recognizer::create(options_.degraded_config)),
+          reload_mutex_(),
+          watcher_(),
+          callback_(std::move(callback)),
+          budget_(std::make_shared<ThreadBudget>(options_.threads,
+                                                 node_count(options_))),
+          jobs_(std::max(options_.read_ahead, options_.max_in_flight),
+                options_.background_share),
+          loaded_(),
+          decoded_(),
+          readers_(),
+          io_backend_(nullptr),
+          decoders_(),
+          workers_(),
+          in_flight_(),
+          accepted_(0),
+          degraded_(0),
+          shed_(0),
+          expired_(0),
+          completed_(0),
+          reloads_(0),
+          reload_failures_(0),
+          coalesced_(0),
+          callback_failures_(0),
+          flights_mutex_(),
+          flights_(),
+          service_mutex_(),
+          service_ms_(0.0),
+          degraded_service_ms_(0.0)
+{
+    in_flight_[0] = 0;
+    in_flight_[1] = 0;
+
+    if (options_.watch_models) {
+        const Config* configs[] = {
+            &options_.config, &options_.degraded_config
+        };
+
+        std::vector<std::string> files;
+        for (const Config* config : configs) {
+            const std::string* paths[] = {
+                &config->classifier_nm1,
+                &config->classifier_nm2,
+                &config->classifier_grouping
+            };
+
+            for (const std::string* path : paths) {
+                if (*path != RECOGNIZER_EMBEDDED_MODEL) {
+                    files.push_back(*path);
+                }
+            }
+        }
+
+        if (!files.empty()) {
+            watcher_.reset(new ModelWatcher(files, [this] { reload(); }));
+        }
+    }
+
+    if (options_.configure_libraries) {
+        ThreadBudget::configure_libraries();
+    }
+    budget_->set_policy(options_.scheduling);
+
+    std::size_t nodes = node_count(options_);
+    for (std::size_t node = 0; node < nodes; ++node) {
+        loaded_.emplace_back(std::unique_ptr<PriorityQueue<Loaded>>(
+                new PriorityQueue<Loaded>(
+                        std::max<std::size_t>(options_.read_ahead / nodes, 1),
+                        options_.background_share)));
+        decoded_.emplace_back(std::unique_ptr<PriorityQueue<Loaded>>(
+                new PriorityQueue<Loaded>(
+                        std::max<std::size_t>(options_.decode_ahead / nodes,
+                                              1),
+                        options_.background_share)));
+    }
+
+    for (std::size_t node = 0; node < nodes; ++node) {
+        readers_.emplace_back(&Engine::reader_loop, this, node);
+    }
+    // Every node used needs at least one decoder too
+    for (std::size_t d = 0; d < std::max(options_.decoders, nodes); ++d) {
+        decoders_.emplace_back(&Engine::decoder_loop, this, d % nodes);
+    }
+    for (std::size_t w = 0; w < options_.workers; ++w) {
+        workers_.emplace_back(&Engine::worker_loop, this, w % nodes);
+    }
+}
+
+Engine::~Engine()
+{
+    watcher_.reset();
+    finish();
+}
+
+/**
+ * Put job into engine.
+ */
+Engine::Admission
+Engine::submit(Job job)
+{
+    // Recognizer would fail on a worker with other pixel types
+    if (!job.image.empty() && job.image.type() != CV_8UC3) {
+        refuse(job, "unsupported image type: 8-bit 3-channel expected");
+        return Admission::rejected;
+    }
+
+    Admission admission = admit(job);
+
+    if (admission == Admission::shed) {
+        refuse(job, "shed: estimated wait exceeds limits");
+        return admission;
+    }
+
+    Priority priority = job.priority;
+    if (!jobs_.push(std::move(job), priority)) {
+        in_flight(priority).fetch_sub(1);
+        return Admission::closed;
+    }
+
+    // Counted once queued, so jobs of closed engine are not
+    if (admission == Admission::degraded) {
+        degraded_.fetch_add(1);
+    } else {
+        accepted_.fetch_add(1);
+    }
+
+    return admission;
+}
+
+/**
+ * Recognize decoded image asynchronously.
+ */
+std::future<Recognizer::Result>
+Engine::get_text_async(const cv::Mat& image, const RequestContext& ctx,
+                       Priority priority)
+{
+    Job job(0, std::string(), ctx, priority);
+    job.image = image;
+
+    return submit_promise(std::move(job));
+}
+
+/**
+ * Decode and recognize encoded image asynchronously.
+ */
+std::future<Recognizer::Result>
+Engine::get_text_async(std::vector<uchar> data, const RequestContext& ctx,
+                       Priority priority)
+{
+    Job job(0, std::string(), ctx, priority);
+    job.data = std::move(data);
+
+    return submit_promise(std::move(job));
+}
+
+/**
+ * Recognize job asynchronously with completion callback.
+ */
+Engine::Admission
+Engine::get_text_async(Job job, Callback done)
+{
+    job.done = std::move(done);
+    return submit(std::move(job));
+}
+
+/**
+ * Submit job completing promise with its result.
+ */
+std::future<Recognizer::Result>
+Engine::submit_promise(Job job)
+{
+    // Callback must be copyable, promise is not
+    std::shared_ptr<std::promise<Recognizer::Result>> promise =
+            std::make_shared<std::promise<Recognizer::Result>>();
+    std::future<Recognizer::Result> future = promise->get_future();
+
+    job.done = [promise](const Outcome& outcome) {
+        // Expired job keeps its partial result
+        if (outcome.error.empty() || outcome.result.expired) {
+            promise->set_value(outcome.result);
+        } else {
+            promise->set_exception(std::make_exception_ptr(
+                    RecException(outcome.error)));
+        }
+    };
+
+    if (submit(std::move(job)) == Admission::closed) {
+        promise->set_exception(std::make_exception_ptr(
+                RecException("engine is closed")));
+    }
+
+    return future;
+}
+
+/**
+ * Report job which is not queued from the calling thread.
+ */
+void
+Engine::refuse(Job& job, const std::string& error)
+{
+    Outcome outcome;
+    outcome.id = job.id;
+    outcome.file = std::move(job.file);
+    outcome.priority = job.priority;
+    outcome.error = error;
+    notify(outcome, job.done);
+}
+
+/**
+ * Decide whether job is accepted, degraded or shed.
+ */
+Engine::Admission
+Engine::admit(Job& job)
+{
+    std::atomic<std::size_t>& counter = in_flight(job.priority);
+    std::size_t ahead = jobs_ahead(job.priority);
+
+    if (counter.fetch_add(1) >= options_.max_in_flight &&
+        options_.max_in_flight) {
+        counter.fetch_sub(1);
+        shed_.fetch_add(1);
+        return Admission::shed;
+    }
+
+    double service_ms, degraded_service_ms;
+    {
+        std::lock_guard<std::mutex> lock(service_mutex_);
+        service_ms = service_ms_;
+        degraded_service_ms = degraded_service_ms_ > 0.0 ?
+                degraded_service_ms_ : service_ms_ / 2.0;
+    }
+
+    // Jobs ahead are shared between workers
+    double wait_ms = ahead * service_ms / options_.workers;
+    double budget_ms = job.context.has_deadline() ?
+            static_cast<double>(job.context.remaining_ms()) : -1.0;
+
+    bool over_target = options_.queue_delay_target_ms > 0.0 &&
+            wait_ms > options_.queue_delay_target_ms;
+    bool misses_deadline = budget_ms >= 0.0 &&
+            wait_ms + service_ms > budget_ms;
+
+    if (!over_target && !misses_deadline) {
+        return Admission::accepted;
+    }
+
+    if (options_.degrade &&
+        (budget_ms < 0.0 || wait_ms + degraded_service_ms <= budget_ms)) {
+        job.degraded = true;
+        return Admission::degraded;
+    }
+
+    counter.fetch_sub(1);
+    shed_.fetch_add(1);
+
+    return Admission::shed;
+}
+
+/**
+ * Number of jobs which will be served before a new job.
+ */
+std::size_t
+Engine::jobs_ahead(Priority priority) const
+{
+    // Interactive job overtakes background jobs at every stage
+    std::size_t ahead = in_flight_[0].load();
+    if (priority == Priority::background) {
+        ahead += in_flight_[1].load();
+    }
+
+    return ahead;
+}
+
+std::atomic<std::size_t>&
+Engine::in_flight(Priority priority)
+{
+    return in_flight_[static_cast<std::size_t>(priority)];
+}
+
+/**
+ * Update mean service time with finished job.
+ */
+void
+Engine::account(double service_ms, bool degraded)
+{
+    std::lock_guard<std::mutex> lock(service_mutex_);
+
+    double& mean = degraded ? degraded_service_ms_ : service_ms_;
+    if (mean <= 0.0) {
+        mean = service_ms;
+    } else {
+        mean += service_weight * (service_ms - mean);
+    }
+}
+
+/**
+ * Report finished job and release its in-flight slot.
+ */
+void
+Engine::complete(const Outcome& outcome, const Callback& done)
+{
+    if (outcome.result.expired) {
+        expired_.fetch_add(1);
+    }
+
+    completed_.fetch_add(1);
+    notify(outcome, done);
+    in_flight(outcome.priority).fetch_sub(1);
+}
+
+/**
+ * Call callback of job or engine, counting its exceptions.
+ */
+void
+Engine::notify(const Outcome& outcome, const Callback& done)
+{
+    // Exception escaping a worker would terminate the process
+    try {
+        if (done) {
+            done(outcome);
+        } else if (callback_) {
+            callback_(outcome);
+        }
+    } catch (...) {
+        callback_failures_.fetch_add(1);
+    }
+}
+
+/**
+ * Snapshot of admission and completion counters.
+ */
+Engine::Counters
+Engine::counters() const
+{
+    Counters counters;
+    counters.accepted = accepted_.load();
+    counters.degraded = degraded_.load();
+    counters.shed = shed_.load();
+    counters.expired = expired_.load();
+    counters.completed = completed_.load();
+    counters.in_flight = in_flight_[0].load() + in_flight_[1].load();
+    counters.background_in_flight = in_flight_[1].load();
+    counters.reloads = reloads_.load();
+    counters.reload_failures = reload_failures_.load();
+    counters.coalesced = coalesced_.load();
+    counters.callback_failures = callback_failures_.load();
+
+    return counters;
+}
+
+/**
+ * Load classifiers again and swap them in.
+ */
+bool
+Engine::reload()
+{
+    // Concurrent reloads would only load the same files twice
+    std::lock_guard<std::mutex> lock(reload_mutex_);
+
+    try {
+        Recognizer::Ptr recognizer = Recognizer::create(options_.config);
+        Recognizer::Ptr degraded =
+                Recognizer::create(options_.degraded_config);
+
+        std::atomic_store(&recognizer_, recognizer);
+        std::atomic_store(&degraded_recognizer_, degraded);
+    } catch (const RecException&) {
+        reload_failures_.fetch_add(1);
+        return false;
+    }
+
+    reloads_.fetch_add(1);
+
+    return true;
+}
+
+/**
+ * Estimated queue delay for a job submitted now.
+ */
+double
+Engine::estimated_wait_ms(Priority priority) const
+{
+    std::lock_guard<std::mutex> lock(service_mutex_);
+    return jobs_ahead(priority) * service_ms_ / options_.workers;
+}
+
+/**
+ * Recognize frames of shared memory ring in place.
+ */
+std::size_t
+Engine::consume(FrameRing& ring, long timeout_ms, Priority priority)
+{
+    std::size_t frames = 0;
+    while (FrameRing::FramePtr frame = ring.next()) {
+        Job job(frame->meta().id, std::string(),
+                RequestContext::timeout(timeout_ms), priority);
+        job.image = frame->image();
+        // Slot is released with the last reference to the frame
+        job.keep = frame;
+
+        if (submit(std::move(job)) == Admission::closed) {
+            break;
+        }
+        ++frames;
+    }
+
+    return frames;
+}
+
+/**
+ * Process all submitted jobs and stop engine threads.
+ */
+void
+Engine::finish()
+{
+    jobs_.close();
+    for (std::thread& reader : readers_) {
+        if (reader.joinable()) {
+            reader.join();
+        }
+    }
+
+    // Readers close loaded queues after last job, decoders drain them
+    for (std::thread& decoder : decoders_) {
+        if (decoder.joinable()) {
+            decoder.join();
+        }
+    }
+
+    for (const std::unique_ptr<PriorityQueue<Loaded>>& decoded : decoded_) {
+        decoded->close();
+    }
+    for (std::thread& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+/**
+ * Number of recognition threads.
+ */
+std::size_t
+Engine::workers() const
+{
+    return options_.workers;
+}
+
+/**
+ * Number of threads engine may run on.
+ */
+std::size_t
+Engine::threads() const
+{
+    return budget_->threads();
+}
+
+/**
+ * Name of file read backend.
+ */
+std::string
+Engine::io_backend() const
+{
+    const char* name = io_backend_.load();
+    return name ? std::string(name) : std::string();
+}
+
+/**
+ * Number of loaded and decoded jobs waiting on all nodes.
+ */
+std::size_t
+Engine::backlog() const
+{
+    std::size_t jobs = 0;
+    for (const std::unique_ptr<PriorityQueue<Loaded>>& loaded : loaded_) {
+        jobs += loaded->size(Priority::interactive) +
+                loaded->size(Priority::background);
+    }
+    for (const std::unique_ptr<PriorityQueue<Loaded>>& decoded : decoded_) {
+        jobs += decoded->size(Priority::interactive) +
+                decoded->size(Priority::background);
+    }
+
+    return jobs;
+}
+
+/**
+ * Load files ahead of workers, buffers and images are passed through.
+ */
+void
+Engine::reader_loop(std::size_t node)
+{
+    // File contents are first touched here, so they are node-local
+    if (loaded_.size() > 1) {
+        Numa::pin(node);
+    }
+
+    // Pread threads inherit affinity of the reader
+    std::unique_ptr<Loader> loader = Loader::create(options_.io_depth,
+                                                    options_.io_backend);
+    io_backend_.store(loader->name());
+
+    PriorityQueue<Loaded>& queue = *loaded_[node];
+
+    // Jobs of reads in flight by tag
+    std::map<std::size_t, Job> reading;
+    std::size_t next_tag = 0;
+    bool open = true;
+
+    while (open || loader->pending()) {
+        // Keep the disk busy while there is room for more reads, wait
+        // for new jobs only when nothing is being read
+        Job job;
+        while (open && loader->pending() < loader->depth()) {
+            if (!loader->pending()) {
+                open = jobs_.pop(job);
+                if (!open) {
+                    break;
+                }
+            } else if (!jobs_.try_pop(job)) {
+                break;
+            }
+
+            if (!job.data.empty() || !job.image.empty()) {
+                Loaded loaded;
+                loaded.data = std::move(job.data);
+                loaded.job = std::move(job);
+                forward(std::move(loaded), queue);
+                continue;
+            }
+
+            // Raster pixels are used where they are mapped
+            if (options_.map_raster && MappedImage::candidate(job.file)) {
+                Recognizer::Clock::time_point start =
+                        Recognizer::Clock::now();
+                MappedImage::Ptr mapped = MappedImage::open(job.file);
+                if (mapped) {
+                    Loaded loaded;
+                    loaded.job = std::move(job);
+                    loaded.job.image = mapped->pixels();
+                    loaded.mapped = mapped;
+                    loaded.load_ms = Recognizer::elapsed_ms(start);
+                    forward(std::move(loaded), queue);
+                    continue;
+                }
+            }
+
+            loader->submit(next_tag, job.file);
+            reading[next_tag++] = std::move(job);
+        }
+
+        Loader::Completion completion;
+        if (!loader->wait(completion)) {
+            continue;
+        }
+
+        std::map<std::size_t, Job>::iterator it =
+                reading.find(completion.tag);
+
+        Loaded loaded;
+        loaded.job = std::move(it->second);
+        loaded.data = std::move(completion.data);
+        loaded.error = std::move(completion.error);
+        loaded.load_ms = completion.load_ms;
+        reading.erase(it);
+
+        forward(std::move(loaded), queue);
+    }
+
+    queue.close();
+}
+
+/**
+ * Pass loaded job to decoders of node.
+ */
+void
+Engine::forward(Loaded loaded, PriorityQueue<Loaded>& queue)
+{
+    Priority priority = loaded.job.priority;
+    queue.push(std::move(loaded), priority);
+}
+
+/**
+ * Attach loaded job to identical job in flight.
+ */
+bool
+Engine::join_flight(Loaded& loaded)
+{
+    const Job& job = loaded.job;
+
+    std::uint64_t hash;
+    std::size_t size;
+    if (!job.image.empty()) {
+        // Decoded images are compared by geometry and pixels
+        int header[] = { job.image.rows, job.image.cols, job.image.type() };
+        hash = fnv1a(static_cast<const uchar*>(
+                             static_cast<const void*>(header)),
+                     sizeof(header));
+
+        std::size_t row_size = job.image.cols * job.image.elemSize();
+        for (int row = 0; row < job.image.rows; ++row) {
+            hash = fnv1a(job.image.ptr(row), row_size, hash);
+        }
+        size = row_size * job.image.rows;
+    } else {
+        hash = fnv1a(loaded.data.data(), loaded.data.size());
+        size = loaded.data.size();
+    }
+
+    // Jobs with their own recognizers coalesce only with each other
+    const Recognizer* recognizer = job.degraded ?
+            job.degraded_recognizer.get() : job.recognizer.get();
+    loaded.key = FlightKey(hash, size, job.degraded, recognizer);
+
+    std::lock_guard<std::mutex> lock(flights_mutex_);
+    auto flight = flights_.find(loaded.key);
+    if (flight == flights_.end()) {
+        flights_[loaded.key];
+        loaded.leader = true;
+        return false;
+    }
+
+    flight->second.push_back(std::move(loaded));
+    coalesced_.fetch_add(1);
+
+    return true;
+}
+
+/**
+ * Report leader outcome to jobs attached to it.
+ */
+void
+Engine::land_flight(const Loaded& leader, const Outcome& outcome)
+{
+    std::vector<Loaded> followers;
+    {
+        std::lock_guard<std::mutex> lock(flights_mutex_);
+        auto flight = flights_.find(leader.key);
+        followers = std::move(flight->second);
+        flights_.erase(flight);
+    }
+
+    for (Loaded& follower : followers) {
+        // Leader stopped early, live follower is recognized on its own.
+        // Followers are parked before decoding, worker token covers it.
+        if (outcome.result.expired && !follower.job.context.expired()) {
+            decode(follower);
+            complete(process(follower), follower.job.done);
+            continue;
+        }
+
+        Outcome copy = outcome;
+        copy.id = follower.job.id;
+        copy.file = std::move(follower.job.file);
+        copy.priority = follower.job.priority;
+        copy.total_ms += follower.load_ms - outcome.load_ms;
+        copy.load_ms = follower.load_ms;
+        copy.coalesced = true;
+        complete(copy, follower.job.done);
+    }
+}
+
+/**
+ * Recognize decoded job.
+ */
+Engine::Outcome
+Engine::process(Loaded& loaded)
+{
+    Outcome outcome;
+    outcome.id = loaded.job.id;
+    outcome.file = std::move(loaded.job.file);
+    outcome.priority = loaded.job.priority;
+    outcome.load_ms = loaded.load_ms;
+    outcome.decode_ms = loaded.decode_ms;
+    outcome.error = std::move(loaded.error);
+
+    Recognizer::Clock::time_point start = Recognizer::Clock::now();
+
+    // Queued jobs keep tokens of idle workers from being borrowed
+    budget_->set_backlog(backlog());
+    loaded.job.context.set_budget(budget_);
+
+    if (outcome.error.empty() && loaded.job.context.expired()) {
+        outcome.result.expired = true;
+        outcome.error = "deadline exceeded";
+    }
+
+    if (outcome.error.empty()) {
+        Recognizer::Ptr recognizer = loaded.job.degraded ?
+                loaded.job.degraded_recognizer : loaded.job.recognizer;
+        if (!recognizer) {
+            recognizer = std::atomic_load(loaded.job.degraded ?
+                                          &degraded_recognizer_ :
+                                          &recognizer_);
+        }
+
+        try {
+            outcome.result = recognizer->recognize(loaded.job.image,
+                                                   loaded.job.on_area,
+                                                   loaded.job.context);
+        } catch (const RecException& ex) {
+            outcome.error = ex.what();
+        } catch (const cv::Exception& ex) {
+            outcome.error = ex.what();
+        } catch (const std::exception& ex) {
+            outcome.error = ex.what();
+        }
+
+        account(Recognizer::elapsed_ms(start), loaded.job.degraded);
+    }
+
+    outcome.total_ms = outcome.load_ms + outcome.decode_ms +
+            Recognizer::elapsed_ms(start);
+    outcome.degraded = loaded.job.degraded;
+
+    return outcome;
+}
+
+/**
+ * Decode loaded files ahead of workers, images are passed through.
+ */
+void
+Engine::decoder_loop(std::size_t node)
+{
+    // Decoded image is allocated on the node
+    if (loaded_.size() > 1) {
+        Numa::pin(node);
+    }
+    ThreadBudget::limit_thread();
+
+    Loaded loaded;
+    while (loaded_[node]->pop(loaded)) {
+        Priority priority = loaded.job.priority;
+
+        // Hashing and decoding share cores with recognition. Attached
+        // jobs get only the final result, so they don't stream areas.
+        bool joined;
+        {
+            ThreadBudget::Token token(*budget_);
+            joined = options_.coalesce && !loaded.job.on_area &&
+                    loaded.error.empty() && join_flight(loaded);
+            if (!joined) {
+                decode(loaded);
+            }
+        }
+
+        if (!joined) {
+            decoded_[node]->push(std::move(loaded), priority);
+        }
+        loaded = Loaded();
+    }
+}
+
+/**
+ * Whether loaded job still needs decoding or conversion.
+ */
+bool
+Engine::undecoded(const Loaded& loaded)
+{
+    // Jobs which will be reported without processing are not decoded
+    if (!loaded.error.empty() || loaded.job.context.expired()) {
+        return false;
+    }
+
+    return loaded.job.image.empty() ||
+            (loaded.mapped && !loaded.mapped->in_place());
+}
+
+/**
+ * Decode loaded file or convert mapped raster in place.
+ */
+void
+Engine::decode(Loaded& loaded)
+{
+    if (undecoded(loaded)) {
+        Recognizer::Clock::time_point start = Recognizer::Clock::now();
+        try {
+            if (loaded.job.image.empty()) {
+                loaded.job.image = cv::imdecode(loaded.data,
+                                                cv::IMREAD_COLOR);
+            } else {
+                // Bottom-up or gray rasters are converted, not decoded
+                loaded.job.image = loaded.mapped->image();
+            }
+        } catch (const cv::Exception& ex) {
+            loaded.job.image = cv::Mat();
+            loaded.error = ex.what();
+        } catch (const std::exception& ex) {
+            loaded.job.image = cv::Mat();
+            loaded.error = ex.what();
+        }
+        loaded.mapped.reset();
+        loaded.decode_ms = Recognizer::elapsed_ms(start);
+    }
+
+    // Only pixels wait for workers
+    loaded.data = std::vector<uchar>();
+}
+
+/**
+ * Recognize decoded images.
+ */
+void
+Engine::worker_loop(std::size_t node)
+{
+    // Channels and ocr state are allocated on the node
+    if (loaded_.size() > 1) {
+        Numa::pin(node);
+    }
+    ThreadBudget::limit_thread();
+
+    Loaded loaded;
+    while (decoded_[node]->pop(loaded)) {
+        Outcome outcome;
+        {
+            ThreadBudget::Token token(*budget_);
+            outcome = process(loaded);
+
+            // Flight is closed before leader is reported, so identical
+            // job submitted from callback starts a new one
+            if (loaded.leader) {
+                land_flight(loaded, outcome);
+            }
+        }
+
+        complete(outcome, loaded.job.done);
+
+        // Don't hold image and callback of finished job while idle
+        loaded = Loaded();
+    }
+}
+
+}
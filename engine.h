@@ -0,0 +1,531 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * @file engine.h
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing batch recognition engine declaration.
+ */
+
+#ifndef ENGINE_H_
+#define ENGINE_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <thread>
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <future>
+#include <map>
+#include <tuple>
+#include <cstdint>
+
+#include "recognizer.h"
+#include "queue.h"
+#include "context.h"
+#include "watcher.h"
+#include "budget.h"
+#include "numa.h"
+#include "loader.h"
+#include "mappedimage.h"
+#include "framering.h"
+
+namespace recognizer
+{
+
+/**
+ * @brief Class Engine runs recognizer over many image files in parallel.
+ *
+ * @detailed Submitted jobs pass through three stages. The reader thread
+ * loads file contents ahead of the workers into a bounded queue, so
+ * workers don't wait for the disk. Decoder threads decode images into
+ * a second bounded queue, which caps decoded pixels waiting in memory.
+ * Worker threads run recognition only, so decoding overlaps with it and
+ * both stages are sized separately. Uncompressed raster files are
+ * neither read nor decoded, they are mapped and recognized where their
+ * pixels lie. Every finished job is reported through the callback from
+ * the worker thread that processed it. Job whose deadline passed
+ * while it was waiting in queues is reported without being processed.
+ *
+ * Admission control bounds the number of jobs in flight and estimates
+ * queue delay of every new job from the mean service time. Job which
+ * would exceed the queue delay target or miss its deadline is switched
+ * to a faster preset or shed.
+ *
+ * Engine recognizers are built from configs of options. A job may
+ * bring its own recognizer, so engines of different models share one
+ * pool of worker threads. Recognizers are replaced on reload RCU-style:
+ * new models are loaded aside and published atomically, jobs already
+ * running finish on the models they started with.
+ *
+ * Jobs have interactive or background priority. At every stage
+ * boundary interactive jobs are taken first, while background jobs get
+ * a configured share of the stage so they don't starve.
+ *
+ * Engine owns one thread budget for workers, OpenCV and OpenMP. With
+ * a deep queue every worker recognizes its own image, with a shallow
+ * queue a running job borrows tokens of idle workers for parallel
+ * parts of its image. Scheduling policy of options may pin either mode.
+ *
+ * On NUMA hosts every node gets its own reader and queues, and
+ * decoders and workers pinned to it. A job taken by a node's reader is
+ * read, decoded, detected and recognized by threads of that node, so
+ * its buffers are allocated on the node by first touch and never cross
+ * the interconnect.
+ *
+ * Identical images in flight at the same time are recognized once:
+ * a decoder hashes loaded content, and a job whose hash matches a job
+ * already in flight waits for it and gets a copy of its result.
+ *
+ * Asynchronous interface takes decoded images or encoded buffers and
+ * completes a future or a per-job callback, so an event loop keeps many
+ * recognitions in flight without blocking. With an in-flight limit set
+ * submission never waits, jobs above the limit are shed instead.
+ */
+
+class Engine {
+public:
+
+    struct Outcome;
+
+    typedef std::function<void(const Outcome&)> Callback;
+
+    /**
+     * @brief Image file, encoded buffer or decoded image to recognize.
+     */
+    struct Job {
+        Job()
+                : id(0), file(), context(), priority(Priority::interactive)
+        {}
+
+        Job(std::size_t i, const std::string& f,
+            const RequestContext& c = RequestContext(),
+            Priority p = Priority::interactive)
+                : id(i), file(f), context(c), priority(p)
+        {}
+
+        std::size_t id;
+        std::string file;
+        // Encoded image, file is not read when it is not empty
+        std::vector<uchar> data{};
+        // Decoded image, used instead of file and data when not empty,
+        // must not be modified until job is finished
+        cv::Mat image{};
+        RequestContext context;
+        Priority priority = Priority::interactive;
+        bool degraded = false;
+        // Recognizers replacing engine ones for this job, may be null
+        Recognizer::Ptr recognizer{};
+        Recognizer::Ptr degraded_recognizer{};
+        // Called instead of engine callback for this job, may be null
+        Callback done{};
+        // Owner of image memory, dropped when job is finished, may be null
+        std::shared_ptr<const void> keep{};
+        // Called for every area as soon as it is recognized, from worker
+        // or budget threads, may be null. Such job isn't coalesced.
+        Recognizer::AreaCallback on_area{};
+    };
+
+    /**
+     * @brief Result of job processing.
+     */
+    struct Outcome {
+        std::size_t id = 0;
+        std::string file{};
+        Recognizer::Result result{};
+        std::string error{};
+        double load_ms = 0.0;
+        double decode_ms = 0.0;
+        double total_ms = 0.0;
+        Priority priority = Priority::interactive;
+        bool degraded = false;
+        // Result has been copied from identical job in flight
+        bool coalesced = false;
+    };
+
+    /**
+     * @brief Engine settings.
+     */
+    struct Options {
+        // Thread budget of engine, 0 means CPUs available to process
+        // with affinity and cgroup quota
+        std::size_t threads = 0;
+        // Number of recognition threads, 0 means thread budget
+        std::size_t workers = 0;
+        // Whether spare threads go to parallel parts of running images
+        ThreadBudget::Policy scheduling = ThreadBudget::Policy::automatic;
+        // Stop OpenCV and OpenMP thread pools of the whole process,
+        // see ThreadBudget::configure_libraries()
+        bool configure_libraries = false;
+        // Pin readers and workers per NUMA node on multi-node hosts
+        bool numa = true;
+        // Number of loaded files waiting for decoders
+        std::size_t read_ahead = 0;
+        // Number of decoding threads, 0 means a quarter of workers
+        std::size_t decoders = 0;
+        // Number of decoded images waiting for workers, 0 means workers
+        std::size_t decode_ahead = 0;
+        // Reads in flight of every reader, 0 means read ahead
+        std::size_t io_depth = 0;
+        // Asynchronous read backend of readers
+        Loader::Backend io_backend = Loader::Backend::automatic;
+        // Map uncompressed BMP, PNM and TIFF files instead of reading
+        // and decoding them
+        bool map_raster = true;
+        // Maximum admitted and not finished jobs of each priority class,
+        // 0 means submit() blocks instead of shedding
+        std::size_t max_in_flight = 0;
+        // Share of every stage given to background jobs while
+        // interactive jobs are waiting
+        double background_share = 0.2;
+        // Estimated queue delay above which new jobs are degraded or
+        // shed, 0 disables the target
+        double queue_delay_target_ms = 0.0;
+        // Degrade jobs instead of shedding when degraded processing fits
+        bool degrade = false;
+        // Detection and ocr parameters of jobs
+        Config config{};
+        // Detection and ocr parameters of degraded jobs
+        Config degraded_config = Config::fast();
+        // Reload models when classifier files change
+        bool watch_models = false;
+        // Recognize identical images in flight once
+        bool coalesce = true;
+    };
+
+    /**
+     * @brief Admission decision for submitted job.
+     */
+    enum class Admission {
+        accepted,
+        degraded,
+        shed,
+        // Decoded image isn't 8-bit 3-channel
+        rejected,
+        closed
+    };
+
+    /**
+     * @brief Engine counters snapshot.
+     */
+    struct Counters {
+        std::size_t accepted = 0;
+        std::size_t degraded = 0;
+        std::size_t shed = 0;
+        std::size_t expired = 0;
+        std::size_t completed = 0;
+        std::size_t in_flight = 0;
+        std::size_t background_in_flight = 0;
+        std::size_t reloads = 0;
+        std::size_t reload_failures = 0;
+        std::size_t coalesced = 0;
+        // Exceptions thrown by completion callbacks, engine ignores them
+        std::size_t callback_failures = 0;
+    };
+
+    /**
+     * @brief Start engine threads.
+     *
+     * @param[in] workers Number of recognition threads, 0 means
+     * number of available CPUs.
+     * @param[in] read_ahead Number of loaded files waiting for workers.
+     * @param[in] callback Called for every finished job.
+     * @throw RecException if classifiers could not be loaded.
+     */
+    Engine(std::size_t workers, std::size_t read_ahead, Callback callback)
+            REC_THROW(RecException);
+
+    /**
+     * @brief Start engine threads.
+     *
+     * @param[in] options Engine settings.
+     * @param[in] callback Called for every finished job without its own
+     * callback, may be null.
+     * @throw RecException if classifiers could not be loaded.
+     */
+    Engine(const Options& options, Callback callback = Callback())
+            REC_THROW(RecException);
+
+    Engine(const Engine&) = delete;
+    Engine& operator=(const Engine&) = delete;
+
+    ~Engine();
+
+    /**
+     * @brief Put job into engine.
+     * @detailed Without in-flight limit waits while read-ahead queue is
+     * full. Shed or rejected job is reported through the callback from
+     * the calling thread before submit returns.
+     *
+     * @param[in] job Image file to recognize.
+     * @return Admission decision.
+     */
+    Admission submit(Job job);
+
+    /**
+     * @brief Recognize decoded image asynchronously.
+     * @detailed Future gets partial result marked expired if deadline
+     * passes or token of context is cancelled, RecException if job is
+     * shed, rejected or fails.
+     *
+     * @param[in] image Image, must not be modified until future is ready.
+     * @param[in] ctx Request deadline and cancel token.
+     * @param[in] priority Priority class of job.
+     * @return Future of recognition result.
+     */
+    std::future<Recognizer::Result> get_text_async(
+            const cv::Mat& image,
+            const RequestContext& ctx = RequestContext(),
+            Priority priority = Priority::interactive);
+
+    /**
+     * @brief Decode and recognize encoded image asynchronously.
+     * @detailed Same as above, image is decoded by engine decoders.
+     */
+    std::future<Recognizer::Result> get_text_async(
+            std::vector<uchar> data,
+            const RequestContext& ctx = RequestContext(),
+            Priority priority = Priority::interactive);
+
+    /**
+     * @brief Recognize job asynchronously with completion callback.
+     * @detailed Callback is called exactly once from a worker thread,
+     * or from the calling thread if job is shed or rejected. Exceptions
+     * thrown by callback are counted in callback_failures and ignored.
+     *
+     * @param[in] job Image to recognize.
+     * @param[in] done Completion callback.
+     * @return Admission decision, callback is not called if closed.
+     */
+    Admission get_text_async(Job job, Callback done);
+
+    /**
+     * @brief Recognize frames of shared memory ring in place.
+     * @detailed Takes frames until ring is closed and drained and submits
+     * them as jobs with frame id, every slot is released when its job is
+     * finished. Results are reported through the engine callback.
+     *
+     * @param[in] ring Ring to take frames from, must outlive the jobs.
+     * @param[in] timeout_ms Deadline of every frame after it is taken,
+     * 0 means no deadline.
+     * @param[in] priority Priority class of frames.
+     * @return Number of frames submitted.
+     */
+    std::size_t consume(FrameRing& ring, long timeout_ms = 0,
+                        Priority priority = Priority::interactive);
+
+    /**
+     * @brief Process all submitted jobs and stop engine threads.
+     */
+    void finish();
+
+    /**
+     * @brief Number of recognition threads.
+     */
+    std::size_t workers() const;
+
+    /**
+     * @brief Number of threads engine may run on.
+     */
+    std::size_t threads() const;
+
+    /**
+     * @brief Name of file read backend, empty before first read.
+     */
+    std::string io_backend() const;
+
+    /**
+     * @brief Snapshot of admission and completion counters.
+     */
+    Counters counters() const;
+
+    /**
+     * @brief Load classifiers again and swap them in.
+     * @detailed Models are loaded in the calling thread while workers
+     * keep running on the current ones. On failure current models are
+     * kept.
+     *
+     * @return true if new models have been published.
+     */
+    bool reload();
+
+    /**
+     * @brief Estimated queue delay for a job submitted now.
+     *
+     * @param[in] priority Priority class of job.
+     */
+    double estimated_wait_ms(Priority priority = Priority::interactive) const;
+
+private:
+
+    /**
+     * @brief Identity of computation.
+     * @detailed Fields are FNV-1a hash of encoded bytes or of geometry
+     * and pixels of decoded image, size of hashed content, whether job
+     * is degraded and recognizer of job, null for engine recognizers.
+     */
+    typedef std::tuple<std::uint64_t, std::size_t, bool,
+                       const Recognizer*> FlightKey;
+
+    /**
+     * @brief Loaded file contents waiting for decoding.
+     */
+    struct Loaded {
+        Job job{};
+        std::vector<uchar> data{};
+        std::string error{};
+        double load_ms = 0.0;
+        double decode_ms = 0.0;
+        // Mapped file the image of job points to
+        MappedImage::Ptr mapped{};
+        // Other identical jobs wait for this one
+        bool leader = false;
+        FlightKey key{};
+    };
+
+    /**
+     * @brief Submit job completing promise with its result.
+     */
+    std::future<Recognizer::Result> submit_promise(Job job);
+
+    /**
+     * @brief Pass loaded job to decoders of node.
+     */
+    void forward(Loaded loaded, PriorityQueue<Loaded>& queue);
+
+    /**
+     * @brief Decide whether job is accepted, degraded or shed.
+     * @detailed Takes in-flight slot of admitted job, submit counts it
+     * as accepted or degraded only when it is queued.
+     */
+    Admission admit(Job& job);
+
+    /**
+     * @brief Report job which is not queued from the calling thread.
+     */
+    void refuse(Job& job, const std::string& error);
+
+    /**
+     * @brief Number of jobs which will be served before a new job.
+     */
+    std::size_t jobs_ahead(Priority priority) const;
+
+    std::atomic<std::size_t>& in_flight(Priority priority);
+
+    /**
+     * @brief Attach loaded job to identical job in flight.
+     * @detailed Job which found no identical one becomes leader of
+     * a new flight. Called by decoders before decoding, so content is
+     * hashed in parallel and the reader only does I/O.
+     *
+     * @return true if job has been attached and waits for leader.
+     */
+    bool join_flight(Loaded& loaded);
+
+    /**
+     * @brief Recognize decoded job.
+     */
+    Outcome process(Loaded& loaded);
+
+    /**
+     * @brief Whether loaded job still needs decoding or conversion.
+     */
+    static bool undecoded(const Loaded& loaded);
+
+    /**
+     * @brief Decode loaded file or convert mapped raster in place.
+     * @detailed Caller holds a thread budget token. Encoded buffer is
+     * dropped, so only pixels wait for workers.
+     */
+    static void decode(Loaded& loaded);
+
+    /**
+     * @brief Report leader outcome to jobs attached to it.
+     */
+    void land_flight(const Loaded& leader, const Outcome& outcome);
+
+    /**
+     * @brief Update mean service time with finished job.
+     */
+    void account(double service_ms, bool degraded);
+
+    /**
+     * @brief Report finished job and release its in-flight slot.
+     */
+    void complete(const Outcome& outcome, const Callback& done);
+
+    /**
+     * @brief Call callback of job or engine, counting its exceptions.
+     */
+    void notify(const Outcome& outcome, const Callback& done);
+
+    void reader_loop(std::size_t node);
+    void decoder_loop(std::size_t node);
+    void worker_loop(std::size_t node);
+
+    /**
+     * @brief Number of loaded and decoded jobs waiting on all nodes.
+     */
+    std::size_t backlog() const;
+
+private:
+    const Options options_;
+    // Accessed with atomic shared_ptr operations only
+    Recognizer::Ptr recognizer_;
+    Recognizer::Ptr degraded_recognizer_;
+    std::mutex reload_mutex_;
+    std::unique_ptr<ModelWatcher> watcher_;
+    Callback callback_;
+    std::shared_ptr<ThreadBudget> budget_;
+    PriorityQueue<Job> jobs_;
+    // Loaded and decoded jobs and reader of every NUMA node used
+    std::vector<std::unique_ptr<PriorityQueue<Loaded>>> loaded_;
+    std::vector<std::unique_ptr<PriorityQueue<Loaded>>> decoded_;
+    std::vector<std::thread> readers_;
+    std::atomic<const char*> io_backend_;
+    std::vector<std::thread> decoders_;
+    std::vector<std::thread> workers_;
+
+    std::atomic<std::size_t> in_flight_[2];
+    std::atomic<std::size_t> accepted_;
+    std::atomic<std::size_t> degraded_;
+    std::atomic<std::size_t> shed_;
+    std::atomic<std::size_t> expired_;
+    std::atomic<std::size_t> completed_;
+    std::atomic<std::size_t> reloads_;
+    std::atomic<std::size_t> reload_failures_;
+    std::atomic<std::size_t> coalesced_;
+    std::atomic<std::size_t> callback_failures_;
+
+    // Jobs waiting for identical leader jobs in flight
+    std::mutex flights_mutex_;
+    std::map<FlightKey, std::vector<Loaded>> flights_;
+
+    mutable std::mutex service_mutex_;
+    double service_ms_;
+    double degraded_service_ms_;
+};
+
+}
+
+#endif // ENGINE_H_
@@ -0,0 +1,453 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * @file framering.cpp
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing shared memory frame ring definition.
+ */
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+
+#include <fcntl.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "framering.h"
+
+namespace recognizer
+{
+
+namespace
+{
+
+const std::uint32_t ring_magic = 0x52434652;  // "RFCR"
+const std::uint32_t ring_version = 1;
+// Slot pixels start at cache line boundary
+const std::size_t data_alignment = 64;
+
+// Atomics are shared between processes, so they must not use locks
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+              "frame ring needs lock free atomics");
+
+enum SlotState : std::uint32_t {
+    slot_free,
+    slot_writing,
+    slot_ready,
+    slot_reading
+};
+
+void
+wait_semaphore(sem_t* sem)
+{
+    while (::sem_wait(sem) && errno == EINTR) {
+    }
+}
+
+}
+
+/**
+ * Ring header in shared memory.
+ */
+struct FrameRing::Shared {
+    std::atomic<std::uint32_t> magic;
+    std::uint32_t version;
+    std::uint64_t slots;
+    std::uint64_t slot_bytes;
+    // Counts of free and published slots
+    sem_t free;
+    sem_t ready;
+    std::atomic<std::uint64_t> sequence;
+    std::atomic<std::uint32_t> closed;
+};
+
+/**
+ * Slot header in shared memory.
+ */
+struct FrameRing::Slot {
+    std::atomic<std::uint32_t> state;
+    // Publication order
+    std::uint64_t sequence;
+    Meta meta;
+};
+
+/**
+ * Create ring and its name.
+ */
+std::unique_ptr<FrameRing>
+FrameRing::create(const std::string& name, std::size_t slots,
+                  std::size_t slot_bytes, bool replace)
+        REC_THROW(RecException)
+{
+    if (!slots || !slot_bytes) {
+        throw RecException("frame ring needs slots");
+    }
+
+    std::size_t data_offset = 0;
+    std::size_t length = layout(slots, slot_bytes, &data_offset);
+
+    if (replace) {
+        ::shm_unlink(name.c_str());
+    }
+
+    int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 && errno == EEXIST) {
+        throw RecException("frame ring " + name + " already exists");
+    } else if (fd < 0) {
+        throw RecException("could not create frame ring " + name + ": " +
+                           std::strerror(errno));
+    }
+
+    if (::ftruncate(fd, static_cast<off_t>(length))) {
+        ::close(fd);
+        ::shm_unlink(name.c_str());
+        throw RecException("could not size frame ring " + name);
+    }
+
+    void* address = ::mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                           MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (address == MAP_FAILED) {
+        ::shm_unlink(name.c_str());
+        throw RecException("could not map frame ring " + name);
+    }
+
+    // Fresh shared memory is zeroed, which is a valid state of atomics
+    Shared* shared = static_cast<Shared*>(address);
+    shared->version = ring_version;
+    shared->slots = slots;
+    shared->slot_bytes = slot_bytes;
+    ::sem_init(&shared->free, 1, static_cast<unsigned>(slots));
+    ::sem_init(&shared->ready, 1, 0);
+
+    std::unique_ptr<FrameRing> ring(
+            new FrameRing(name, address, length, true));
+
+    // Openers check magic, so it is published last
+    shared->magic.store(ring_magic, std::memory_order_release);
+
+    return ring;
+}
+
+/**
+ * Open ring created by other process.
+ */
+std::unique_ptr<FrameRing>
+FrameRing::open(const std::string& name) REC_THROW(RecException)
+{
+    int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) {
+        throw RecException("could not open frame ring " + name);
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) ||
+        static_cast<std::size_t>(st.st_size) < sizeof(Shared)) {
+        ::close(fd);
+        throw RecException("frame ring " + name + " is not initialized");
+    }
+
+    std::size_t length = static_cast<std::size_t>(st.st_size);
+    void* address = ::mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                           MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (address == MAP_FAILED) {
+        throw RecException("could not map frame ring " + name);
+    }
+
+    Shared* shared = static_cast<Shared*>(address);
+    std::size_t data_offset = 0;
+    if (shared->magic.load(std::memory_order_acquire) != ring_magic ||
+        shared->version != ring_version ||
+        layout(shared->slots, shared->slot_bytes, &data_offset) > length) {
+        ::munmap(address, length);
+        throw RecException("frame ring " + name + " is not initialized");
+    }
+
+    return std::unique_ptr<FrameRing>(
+            new FrameRing(name, address, length, false));
+}
+
+FrameRing::FrameRing(const std::string& name, void* address,
+                     std::size_t length, bool owner)
+        : name_(name),
+          address_(address),
+          length_(length),
+          owner_(owner),
+          shared_(static_cast<Shared*>(address)),
+          data_offset_(0)
+{
+    layout(shared_->slots, shared_->slot_bytes, &data_offset_);
+}
+
+FrameRing::~FrameRing()
+{
+    if (owner_) {
+        // Processes which opened the ring keep their mapping
+        ::shm_unlink(name_.c_str());
+    }
+
+    ::munmap(address_, length_);
+}
+
+/**
+ * Size of ring memory and offset of first slot pixels.
+ */
+std::size_t
+FrameRing::layout(std::size_t slots, std::size_t slot_bytes,
+                  std::size_t* data_offset)
+{
+    std::size_t stride = (slot_bytes + data_alignment - 1) /
+            data_alignment * data_alignment;
+    std::size_t headers = sizeof(Shared) + slots * sizeof(Slot);
+
+    *data_offset = (headers + data_alignment - 1) /
+            data_alignment * data_alignment;
+
+    if (stride && slots > (std::numeric_limits<std::size_t>::max() -
+                           *data_offset) / stride) {
+        return std::numeric_limits<std::size_t>::max();
+    }
+
+    return *data_offset + slots * stride;
+}
+
+FrameRing::Slot&
+FrameRing::slot(std::size_t index) const
+{
+    Slot* slots = static_cast<Slot*>(static_cast<void*>(
+            static_cast<char*>(address_) + sizeof(Shared)));
+    return slots[index];
+}
+
+uchar*
+FrameRing::data(std::size_t index) const
+{
+    std::size_t stride = (shared_->slot_bytes + data_alignment - 1) /
+            data_alignment * data_alignment;
+    return static_cast<uchar*>(address_) + data_offset_ + index * stride;
+}
+
+/**
+ * Take free slot for frame of given geometry.
+ */
+std::unique_ptr<FrameRing::Writer>
+FrameRing::begin(const cv::Size& size, int type, bool wait)
+        REC_THROW(RecException)
+{
+    std::size_t step = static_cast<std::size_t>(size.width) *
+            CV_ELEM_SIZE(type);
+    if (size.width <= 0 || size.height <= 0 ||
+        step * static_cast<std::size_t>(size.height) > shared_->slot_bytes) {
+        throw RecException("frame doesn't fit frame ring slot");
+    }
+
+    if (shared_->closed.load()) {
+        return std::unique_ptr<Writer>();
+    }
+
+    if (wait) {
+        wait_semaphore(&shared_->free);
+    } else if (::sem_trywait(&shared_->free)) {
+        return std::unique_ptr<Writer>();
+    }
+
+    // Semaphore guarantees a free slot, slots are freed in any order
+    for (std::size_t s = 0; ; s = (s + 1) % shared_->slots) {
+        std::uint32_t state = slot_free;
+        if (slot(s).state.compare_exchange_strong(state, slot_writing)) {
+            return std::unique_ptr<Writer>(new Writer(*this, s, size, type));
+        }
+    }
+}
+
+/**
+ * Copy image into free slot and publish it.
+ */
+bool
+FrameRing::write(const cv::Mat& image, std::uint64_t id,
+                 std::int64_t timestamp_us, bool wait) REC_THROW(RecException)
+{
+    std::unique_ptr<Writer> writer = begin(image.size(), image.type(), wait);
+    if (!writer) {
+        return false;
+    }
+
+    image.copyTo(writer->image());
+    writer->publish(id, timestamp_us);
+
+    return true;
+}
+
+/**
+ * Take oldest published frame.
+ */
+FrameRing::FramePtr
+FrameRing::next()
+{
+    for (;;) {
+        wait_semaphore(&shared_->ready);
+
+        // Producers publish concurrently, take the earliest frame
+        std::size_t oldest = shared_->slots;
+        for (std::size_t s = 0; s < shared_->slots; ++s) {
+            if (slot(s).state.load() == slot_ready &&
+                (oldest == shared_->slots ||
+                 slot(s).sequence < slot(oldest).sequence)) {
+                oldest = s;
+            }
+        }
+
+        if (oldest == shared_->slots) {
+            if (shared_->closed.load()) {
+                // Wake up next consumer, it finds the ring closed too
+                ::sem_post(&shared_->ready);
+                return FramePtr();
+            }
+            continue;
+        }
+
+        std::uint32_t state = slot_ready;
+        if (slot(oldest).state.compare_exchange_strong(state,
+                                                       slot_reading)) {
+            return FramePtr(new Frame(*this, oldest));
+        }
+
+        // Other consumer took it, its token is ours
+        ::sem_post(&shared_->ready);
+    }
+}
+
+/**
+ * Tell consumers no more frames will be published.
+ */
+void
+FrameRing::close()
+{
+    if (!shared_->closed.exchange(1)) {
+        ::sem_post(&shared_->ready);
+    }
+}
+
+std::size_t
+FrameRing::slots() const
+{
+    return shared_->slots;
+}
+
+std::size_t
+FrameRing::slot_bytes() const
+{
+    return shared_->slot_bytes;
+}
+
+/**
+ * Return slot to free ones.
+ */
+void
+FrameRing::release(std::size_t index)
+{
+    slot(index).state.store(slot_free);
+    ::sem_post(&shared_->free);
+}
+
+FrameRing::Frame::Frame(FrameRing& ring, std::size_t slot)
+        : ring_(ring),
+          slot_(slot),
+          meta_(ring.slot(slot).meta),
+          image_(meta_.rows, meta_.cols, meta_.type, ring.data(slot),
+                 meta_.step)
+{}
+
+FrameRing::Frame::~Frame()
+{
+    ring_.release(slot_);
+}
+
+const FrameRing::Meta&
+FrameRing::Frame::meta() const
+{
+    return meta_;
+}
+
+const cv::Mat&
+FrameRing::Frame::image() const
+{
+    return image_;
+}
+
+FrameRing::Writer::Writer(FrameRing& ring, std::size_t slot,
+                          const cv::Size& size, int type)
+        : ring_(ring),
+          slot_(slot),
+          meta_(),
+          image_(size.height, size.width, type, ring.data(slot)),
+          published_(false)
+{
+    meta_.rows = image_.rows;
+    meta_.cols = image_.cols;
+    meta_.type = image_.type();
+    meta_.step = image_.step;
+}
+
+FrameRing::Writer::~Writer()
+{
+    if (!published_) {
+        ring_.release(slot_);
+    }
+}
+
+cv::Mat&
+FrameRing::Writer::image()
+{
+    return image_;
+}
+
+/**
+ * Make frame available to consumers.
+ */
+void
+FrameRing::Writer::publish(std::uint64_t id, std::int64_t timestamp_us)
+{
+    if (published_) {
+        return;
+    }
+
+    // Geometry is the one of slot memory even if image was replaced
+    Slot& slot = ring_.slot(slot_);
+    slot.meta = meta_;
+    slot.meta.id = id;
+    slot.meta.timestamp_us = timestamp_us;
+    slot.sequence = ring_.shared_->sequence.fetch_add(1);
+
+    // Metadata is visible before slot is seen ready
+    slot.state.store(slot_ready, std::memory_order_release);
+    published_ = true;
+
+    ::sem_post(&ring_.shared_->ready);
+}
+
+}
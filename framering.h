@@ -0,0 +1,246 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * @file framering.h
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing shared memory frame ring declaration.
+ */
+
+#ifndef FRAMERING_H_
+#define FRAMERING_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <opencv2/core.hpp>
+
+#include "recexcept.h"
+
+namespace recognizer
+{
+
+/**
+ * @brief Class FrameRing passes raw frames between processes through
+ * a ring of shared memory slots.
+ *
+ * @detailed Producers write pixels directly into a free slot and
+ * publish it with frame metadata. Consumer takes published frames in
+ * publication order and uses their pixels in place, slot is released
+ * when the last reference to the frame is dropped, so frames may be
+ * released out of order. Any number of producer and consumer processes
+ * may share a ring. Ring is created by one process and opened by the
+ * others by name, its creator removes the name on destruction.
+ * Ring must outlive frames and writers taken from it.
+ *
+ * Slots are not owned by processes: slot of a frame or writer held by
+ * a process which crashed is never released, and the ring runs with
+ * one slot less until it is created again.
+ */
+
+class FrameRing {
+public:
+
+    /**
+     * @brief Frame metadata set by producer.
+     */
+    struct Meta {
+        std::uint64_t id = 0;
+        // Capture time in producer clock, microseconds
+        std::int64_t timestamp_us = 0;
+        std::int32_t rows = 0;
+        std::int32_t cols = 0;
+        std::int32_t type = 0;
+        std::uint64_t step = 0;
+    };
+
+    /**
+     * @brief Published frame taken by consumer.
+     */
+    class Frame {
+    public:
+        Frame(FrameRing& ring, std::size_t slot);
+
+        Frame(const Frame&) = delete;
+        Frame& operator=(const Frame&) = delete;
+
+        /**
+         * @brief Release slot.
+         */
+        ~Frame();
+
+        const Meta& meta() const;
+
+        /**
+         * @brief Pixels in slot, valid while frame is alive.
+         */
+        const cv::Mat& image() const;
+
+    private:
+        FrameRing& ring_;
+        std::size_t slot_;
+        Meta meta_;
+        cv::Mat image_;
+    };
+
+    /**
+     * @brief Free slot being written by producer.
+     */
+    class Writer {
+    public:
+        Writer(FrameRing& ring, std::size_t slot, const cv::Size& size,
+               int type);
+
+        Writer(const Writer&) = delete;
+        Writer& operator=(const Writer&) = delete;
+
+        /**
+         * @brief Return slot unpublished if publish() wasn't called.
+         */
+        ~Writer();
+
+        /**
+         * @brief Pixels to fill in place, header over slot memory.
+         */
+        cv::Mat& image();
+
+        /**
+         * @brief Make frame available to consumers.
+         *
+         * @param[in] id Frame id.
+         * @param[in] timestamp_us Capture time, microseconds.
+         */
+        void publish(std::uint64_t id, std::int64_t timestamp_us = 0);
+
+    private:
+        FrameRing& ring_;
+        std::size_t slot_;
+        Meta meta_;
+        cv::Mat image_;
+        bool published_;
+    };
+
+    typedef std::shared_ptr<Frame> FramePtr;
+
+    /**
+     * @brief Create ring and its name.
+     * @detailed Existing ring of the same name is replaced only when
+     * asked, processes using it keep the old ring and never see frames
+     * of the new one.
+     *
+     * @param[in] name Shared memory name, like "/frames".
+     * @param[in] slots Number of slots.
+     * @param[in] slot_bytes Maximum pixel data size of frame.
+     * @param[in] replace Remove existing ring of the name, like a stale
+     * one left by a crashed creator.
+     * @throw RecException if shared memory could not be created or ring
+     * of the name exists and replace is false.
+     */
+    static std::unique_ptr<FrameRing> create(const std::string& name,
+                                             std::size_t slots,
+                                             std::size_t slot_bytes,
+                                             bool replace = false)
+            REC_THROW(RecException);
+
+    /**
+     * @brief Open ring created by other process.
+     *
+     * @param[in] name Shared memory name.
+     * @throw RecException if ring doesn't exist or is not initialized.
+     */
+    static std::unique_ptr<FrameRing> open(const std::string& name)
+            REC_THROW(RecException);
+
+    FrameRing(const FrameRing&) = delete;
+    FrameRing& operator=(const FrameRing&) = delete;
+
+    ~FrameRing();
+
+    /**
+     * @brief Take free slot for frame of given geometry.
+     *
+     * @param[in] size Frame size.
+     * @param[in] type OpenCV type of frame, like CV_8UC3.
+     * @param[in] wait Wait for free slot instead of returning null.
+     * @return Writer of slot, null if ring is full and wait is false or
+     * ring has been closed.
+     * @throw RecException if frame doesn't fit a slot.
+     */
+    std::unique_ptr<Writer> begin(const cv::Size& size, int type,
+                                  bool wait = true)
+            REC_THROW(RecException);
+
+    /**
+     * @brief Copy image into free slot and publish it.
+     *
+     * @return false if ring is full and wait is false or it is closed.
+     * @throw RecException if image doesn't fit a slot.
+     */
+    bool write(const cv::Mat& image, std::uint64_t id,
+               std::int64_t timestamp_us = 0, bool wait = true)
+            REC_THROW(RecException);
+
+    /**
+     * @brief Take oldest published frame, wait while there is none.
+     *
+     * @return Frame, null if ring has been closed and drained.
+     */
+    FramePtr next();
+
+    /**
+     * @brief Tell consumers no more frames will be published.
+     */
+    void close();
+
+    std::size_t slots() const;
+    std::size_t slot_bytes() const;
+
+private:
+    struct Shared;
+    struct Slot;
+
+    FrameRing(const std::string& name, void* address, std::size_t length,
+              bool owner);
+
+    static std::size_t layout(std::size_t slots, std::size_t slot_bytes,
+                              std::size_t* data_offset);
+
+    Slot& slot(std::size_t index) const;
+    uchar* data(std::size_t index) const;
+
+    /**
+     * @brief Return slot to free ones.
+     */
+    void release(std::size_t index);
+
+    std::string name_;
+    void* address_;
+    std::size_t length_;
+    bool owner_;
+    Shared* shared_;
+    std::size_t data_offset_;
+};
+
+}
+
+#endif // FRAMERING_H_
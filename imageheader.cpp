@@ -0,0 +1,475 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * @file imageheader.cpp
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing image header parser definition.
+ */
+
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "imageheader.h"
+
+namespace recognizer
+{
+
+namespace
+{
+
+// Enough for PNG, GIF, BMP and headers of most PNM and TIFF files
+const std::size_t header_bytes = 4 * 1024;
+// PNM comments or TIFF directory placed further
+const std::size_t max_header_bytes = 64 * 1024;
+
+std::uint32_t
+be16(const uchar* p)
+{
+    return (std::uint32_t(p[0]) << 8) | p[1];
+}
+
+std::uint32_t
+be32(const uchar* p)
+{
+    return (std::uint32_t(p[0]) << 24) | (std::uint32_t(p[1]) << 16) |
+            (std::uint32_t(p[2]) << 8) | p[3];
+}
+
+std::uint32_t
+le16(const uchar* p)
+{
+    return (std::uint32_t(p[1]) << 8) | p[0];
+}
+
+std::uint32_t
+le32(const uchar* p)
+{
+    return (std::uint32_t(p[3]) << 24) | (std::uint32_t(p[2]) << 16) |
+            (std::uint32_t(p[1]) << 8) | p[0];
+}
+
+/**
+ * Start of frame, except huffman and arithmetic table markers.
+ */
+bool
+jpeg_frame(uchar marker)
+{
+    return marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 &&
+            marker != 0xc8 && marker != 0xcc;
+}
+
+/**
+ * Markers without length.
+ */
+bool
+jpeg_standalone(uchar marker)
+{
+    return marker == 0xd8 || (marker >= 0xd0 && marker <= 0xd7) ||
+            marker == 0x01;
+}
+
+/**
+ * Read up to size bytes at offset, fewer at the end of file.
+ */
+std::size_t
+read_at(int fd, std::size_t offset, uchar* data, std::size_t size)
+{
+    std::size_t done = 0;
+    while (done < size) {
+        ssize_t rc = ::pread(fd, data + done, size - done,
+                             static_cast<off_t>(offset + done));
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rc <= 0) {
+            break;
+        }
+        done += static_cast<std::size_t>(rc);
+    }
+
+    return done;
+}
+
+}
+
+/**
+ * Parse header from the beginning of encoded image.
+ */
+ImageHeader
+ImageHeader::parse(const uchar* data, std::size_t size)
+{
+    ImageHeader header;
+
+    if (size >= 24 && !std::memcmp(data, "\x89PNG\r\n\x1a\n", 8) &&
+        !std::memcmp(data + 12, "IHDR", 4)) {
+        header.format = Format::png;
+        header.size = cv::Size(static_cast<int>(be32(data + 16)),
+                               static_cast<int>(be32(data + 20)));
+    } else if (size >= 4 && data[0] == 0xff && data[1] == 0xd8) {
+        if (!parse_jpeg(data, size, header)) {
+            return ImageHeader();
+        }
+    } else if (size >= 10 && (!std::memcmp(data, "GIF87a", 6) ||
+                              !std::memcmp(data, "GIF89a", 6))) {
+        header.format = Format::gif;
+        header.size = cv::Size(static_cast<int>(le16(data + 6)),
+                               static_cast<int>(le16(data + 8)));
+    } else if (size >= 26 && data[0] == 'B' && data[1] == 'M') {
+        header.format = Format::bmp;
+        if (le32(data + 14) == 12) {
+            // OS/2 core header has 16 bit dimensions
+            header.size = cv::Size(static_cast<int>(le16(data + 18)),
+                                   static_cast<int>(le16(data + 20)));
+        } else {
+            // Negative height means top-down rows
+            std::int32_t height = static_cast<std::int32_t>(le32(data + 22));
+            header.size = cv::Size(static_cast<int>(le32(data + 18)),
+                                   height < 0 ? -height : height);
+
+            // Only 24 bit rows without compression are plain pixels
+            if (size >= 34 && le16(data + 28) == 24 && !le32(data + 30)) {
+                header.pixel_offset = le32(data + 10);
+                header.row_step = (header.size.width * 3 + 3) / 4 * 4;
+                header.channels = 3;
+                header.bottom_up = height > 0;
+            }
+        }
+    } else if (size >= 3 && data[0] == 'P' && data[1] >= '1' &&
+               data[1] <= '6') {
+        if (!parse_pnm(data, size, header)) {
+            return ImageHeader();
+        }
+    } else if (size >= 8 && (!std::memcmp(data, "II*\0", 4) ||
+                             !std::memcmp(data, "MM\0*", 4))) {
+        if (!parse_tiff(data, size, header)) {
+            return ImageHeader();
+        }
+    }
+
+    return header.valid() ? header : ImageHeader();
+}
+
+/**
+ * Read and parse header of image file.
+ */
+ImageHeader
+ImageHeader::read(const std::string& file)
+{
+    int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return ImageHeader();
+    }
+
+    std::vector<uchar> data(header_bytes);
+    std::size_t size = read_at(fd, 0, data.data(), data.size());
+
+    ImageHeader header = parse(data.data(), size);
+    if (!header.valid() && size >= 4 && data[0] == 0xff && data[1] == 0xd8) {
+        // Frame header is behind metadata, segments are skipped unread
+        if (!read_jpeg(fd, header)) {
+            header = ImageHeader();
+        }
+    } else if (!header.valid() && size == data.size()) {
+        data.resize(max_header_bytes);
+        size += read_at(fd, size, data.data() + size, data.size() - size);
+
+        header = parse(data.data(), size);
+    }
+
+    ::close(fd);
+
+    return header;
+}
+
+bool
+ImageHeader::valid() const
+{
+    return format != Format::unknown && size.width > 0 && size.height > 0;
+}
+
+bool
+ImageHeader::raw() const
+{
+    return valid() && pixel_offset && row_step && channels;
+}
+
+/**
+ * Find frame header among JPEG segments.
+ */
+bool
+ImageHeader::parse_jpeg(const uchar* data, std::size_t size,
+                        ImageHeader& header)
+{
+    std::size_t pos = 2;
+    while (pos + 4 <= size) {
+        if (data[pos] != 0xff) {
+            return false;
+        }
+
+        uchar marker = data[pos + 1];
+        if (marker == 0xff) {
+            // Fill byte
+            ++pos;
+            continue;
+        }
+
+        if (jpeg_frame(marker)) {
+            if (pos + 9 > size) {
+                return false;
+            }
+
+            header.format = Format::jpeg;
+            header.size = cv::Size(static_cast<int>(be16(data + pos + 7)),
+                                   static_cast<int>(be16(data + pos + 5)));
+            return true;
+        }
+
+        if (jpeg_standalone(marker)) {
+            pos += 2;
+            continue;
+        }
+
+        pos += 2 + be16(data + pos + 2);
+    }
+
+    return false;
+}
+
+/**
+ * Find frame header of JPEG file reading only segment headers.
+ */
+bool
+ImageHeader::read_jpeg(int fd, ImageHeader& header)
+{
+    // Marker, length and frame dimensions
+    uchar segment[9];
+
+    std::size_t pos = 2;
+    for (;;) {
+        std::size_t size = read_at(fd, pos, segment, sizeof(segment));
+        if (size < 4 || segment[0] != 0xff) {
+            return false;
+        }
+
+        uchar marker = segment[1];
+        if (marker == 0xff) {
+            // Fill byte
+            ++pos;
+            continue;
+        }
+
+        if (jpeg_frame(marker)) {
+            if (size < sizeof(segment)) {
+                return false;
+            }
+
+            header.format = Format::jpeg;
+            header.size = cv::Size(static_cast<int>(be16(segment + 7)),
+                                   static_cast<int>(be16(segment + 5)));
+            return header.valid();
+        }
+
+        if (jpeg_standalone(marker)) {
+            pos += 2;
+            continue;
+        }
+
+        pos += 2 + be16(segment + 2);
+    }
+}
+
+/**
+ * Read width, height and maximum value fields of PNM header.
+ */
+bool
+ImageHeader::parse_pnm(const uchar* data, std::size_t size,
+                       ImageHeader& header)
+{
+    std::size_t pos = 2;
+    long fields[3] = { 0, 0, 0 };
+
+    // Binary gray and color maps have maximum value field
+    bool binary = data[1] == '5' || data[1] == '6';
+
+    for (std::size_t f = 0; f < (binary ? 3u : 2u); ++f) {
+        long& field = fields[f];
+
+        // Skip whitespace and comments
+        while (pos < size && (std::isspace(data[pos]) || data[pos] == '#')) {
+            if (data[pos] == '#') {
+                while (pos < size && data[pos] != '\n') {
+                    ++pos;
+                }
+            } else {
+                ++pos;
+            }
+        }
+
+        if (pos >= size || !std::isdigit(data[pos])) {
+            return false;
+        }
+
+        while (pos < size && std::isdigit(data[pos])) {
+            field = field * 10 + (data[pos] - '0');
+            ++pos;
+        }
+    }
+
+    header.format = Format::pnm;
+    header.size = cv::Size(static_cast<int>(fields[0]),
+                           static_cast<int>(fields[1]));
+
+    // Pixels follow single whitespace after maximum value
+    if (binary && fields[2] > 0 && fields[2] < 256 &&
+        pos < size && std::isspace(data[pos])) {
+        header.channels = data[1] == '6' ? 3 : 1;
+        header.pixel_offset = pos + 1;
+        header.row_step = static_cast<std::size_t>(header.size.width) *
+                header.channels;
+    }
+
+    return true;
+}
+
+/**
+ * Read image width and length tags of first TIFF directory.
+ * @detailed Pixel layout is known for uncompressed 8 bit gray or RGB
+ * chunky images whose strips are stored one after another.
+ */
+bool
+ImageHeader::parse_tiff(const uchar* data, std::size_t size,
+                        ImageHeader& header)
+{
+    bool little = data[0] == 'I';
+    auto u16 = [little](const uchar* p) { return little ? le16(p) : be16(p); };
+    auto u32 = [little](const uchar* p) { return little ? le32(p) : be32(p); };
+
+    // Short or long array, inline if it fits the value field
+    struct Array {
+        const uchar* values;
+        std::size_t count;
+        std::uint32_t type;
+    };
+    auto at = [&](const Array& array, std::size_t i) -> std::size_t {
+        return array.type == 3 ? u16(array.values + 2 * i) :
+                u32(array.values + 4 * i);
+    };
+
+    std::size_t ifd = u32(data + 4);
+    if (ifd + 2 > size) {
+        return false;
+    }
+
+    std::uint32_t bits = 1;
+    std::uint32_t compression = 1;
+    std::uint32_t photometric = 0;
+    std::uint32_t samples = 1;
+    std::uint32_t planar = 1;
+    Array offsets = { nullptr, 0, 0 };
+    Array counts = { nullptr, 0, 0 };
+
+    std::size_t entries = u16(data + ifd);
+    for (std::size_t e = 0; e < entries; ++e) {
+        const uchar* entry = data + ifd + 2 + 12 * e;
+        if (entry + 12 > data + size) {
+            return false;
+        }
+
+        std::uint32_t tag = u16(entry);
+        std::uint32_t type = u16(entry + 2);
+        std::size_t count = u32(entry + 4);
+        // Short values are left justified in the value field
+        std::uint32_t value = type == 3 ? u16(entry + 8) : u32(entry + 8);
+
+        Array array = { entry + 8, count, type };
+        std::size_t bytes = count * (type == 3 ? 2 : 4);
+        if (bytes > 4) {
+            std::size_t pos = u32(entry + 8);
+            array.values = pos + bytes <= size ? data + pos : nullptr;
+        }
+        if (type != 3 && type != 4) {
+            array.values = nullptr;
+        }
+
+        switch (tag) {
+        case 256:
+            header.size.width = static_cast<int>(value);
+            break;
+        case 257:
+            header.size.height = static_cast<int>(value);
+            break;
+        case 258:
+            // Samples of all channels have the same depth
+            bits = array.values ? static_cast<std::uint32_t>(at(array, 0)) : 0;
+            break;
+        case 259:
+            compression = value;
+            break;
+        case 262:
+            photometric = value;
+            break;
+        case 273:
+            offsets = array;
+            break;
+        case 277:
+            samples = value;
+            break;
+        case 279:
+            counts = array;
+            break;
+        case 284:
+            planar = value;
+            break;
+        }
+    }
+
+    header.format = Format::tiff;
+
+    // Black is zero gray or RGB without compression
+    if (bits != 8 || compression != 1 || planar != 1 ||
+        !((photometric == 1 && samples == 1) ||
+          (photometric == 2 && samples == 3)) ||
+        !offsets.values || !counts.values || !offsets.count ||
+        offsets.count != counts.count) {
+        return true;
+    }
+
+    for (std::size_t s = 0; s + 1 < offsets.count; ++s) {
+        if (at(offsets, s) + at(counts, s) != at(offsets, s + 1)) {
+            return true;
+        }
+    }
+
+    header.channels = static_cast<int>(samples);
+    header.pixel_offset = at(offsets, 0);
+    header.row_step = static_cast<std::size_t>(header.size.width) * samples;
+
+    return true;
+}
+
+}
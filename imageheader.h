@@ -0,0 +1,113 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * @file imageheader.h
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing image header parser declaration.
+ */
+
+#ifndef IMAGEHEADER_H_
+#define IMAGEHEADER_H_
+
+#include <cstddef>
+#include <string>
+
+#include <opencv2/core.hpp>
+
+namespace recognizer
+{
+
+/**
+ * @brief Class ImageHeader reads image format and dimensions from the
+ * first bytes of a file without decoding it.
+ *
+ * @detailed Supports JPEG, PNG, GIF, BMP, PNM and TIFF. Headers are
+ * enough to estimate recognition cost before the image is loaded. For
+ * uncompressed 8 bit BMP, PNM and TIFF rasters the header also gives
+ * layout of pixel data, so the file may be used without decoding.
+ */
+
+class ImageHeader {
+public:
+
+    enum class Format {
+        unknown,
+        jpeg,
+        png,
+        gif,
+        bmp,
+        pnm,
+        tiff
+    };
+
+    /**
+     * @brief Parse header from the beginning of encoded image.
+     *
+     * @param[in] data First bytes of image.
+     * @param[in] size Number of bytes.
+     * @return Header, format unknown if it could not be parsed.
+     */
+    static ImageHeader parse(const uchar* data, std::size_t size);
+
+    /**
+     * @brief Read and parse header of image file.
+     * @detailed Reads the first few kilobytes. Segments of JPEG files
+     * are skipped reading only their headers until the frame header.
+     *
+     * @param[in] file Name of image file.
+     * @return Header, format unknown if file could not be read or parsed.
+     */
+    static ImageHeader read(const std::string& file);
+
+    /**
+     * @brief Whether format and dimensions are known.
+     */
+    bool valid() const;
+
+    /**
+     * @brief Whether pixel data layout is known.
+     */
+    bool raw() const;
+
+    Format format = Format::unknown;
+    cv::Size size{};
+    // Layout of uncompressed 8 bit pixel data, zero offset if pixels are
+    // compressed, palette based or of other depth
+    std::size_t pixel_offset = 0;
+    std::size_t row_step = 0;
+    int channels = 0;
+    // Rows are stored from the last one
+    bool bottom_up = false;
+
+private:
+    static bool parse_jpeg(const uchar* data, std::size_t size,
+                           ImageHeader& header);
+    static bool parse_pnm(const uchar* data, std::size_t size,
+                          ImageHeader& header);
+    static bool parse_tiff(const uchar* data, std::size_t size,
+                           ImageHeader& header);
+    static bool read_jpeg(int fd, ImageHeader& header);
+};
+
+}
+
+#endif // IMAGEHEADER_H_
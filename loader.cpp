@@ -0,0 +1,470 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * @file loader.cpp
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing asynchronous file loader definition.
+ */
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <set>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef RECOGNIZER_IO_URING
+#include <liburing.h>
+#endif
+
+#include "loader.h"
+#include "queue.h"
+
+namespace recognizer
+{
+
+namespace
+{
+
+typedef std::chrono::steady_clock Clock;
+
+double
+elapsed_ms(const Clock::time_point& start)
+{
+    return std::chrono::duration<double, std::milli>(
+        Clock::now() - start).count();
+}
+
+/**
+ * Read whole buffer from the start of file.
+ */
+bool
+read_all(int fd, std::vector<uchar>& data)
+{
+    std::size_t done = 0;
+    while (done < data.size()) {
+        ssize_t rc = ::pread(fd, data.data() + done, data.size() - done,
+                             static_cast<off_t>(done));
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rc <= 0) {
+            return false;
+        }
+        done += static_cast<std::size_t>(rc);
+    }
+
+    return true;
+}
+
+/**
+ * Loader running pread on a pool of threads.
+ */
+class PreadLoader : public Loader {
+public:
+    explicit PreadLoader(std::size_t depth)
+            : Loader(depth),
+              requests_(depth),
+              completions_(depth),
+              threads_()
+    {
+        for (std::size_t t = 0; t < depth; ++t) {
+            threads_.emplace_back(&PreadLoader::read_loop, this);
+        }
+    }
+
+    ~PreadLoader() override
+    {
+        requests_.close();
+        for (std::thread& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    void submit(std::size_t tag, const std::string& file) override
+    {
+        ++pending_;
+        requests_.push(Request(tag, file, Clock::now()));
+    }
+
+    bool wait(Completion& completion) override
+    {
+        if (!pending_) {
+            return false;
+        }
+
+        completions_.pop(completion);
+        --pending_;
+
+        return true;
+    }
+
+    const char* name() const override
+    {
+        return "pread";
+    }
+
+private:
+    struct Request {
+        Request()
+                : tag(0), file(), start()
+        {}
+
+        Request(std::size_t t, const std::string& f,
+                const Clock::time_point& s)
+                : tag(t), file(f), start(s)
+        {}
+
+        std::size_t tag;
+        std::string file;
+        Clock::time_point start;
+    };
+
+    void read_loop()
+    {
+        Request request;
+        while (requests_.pop(request)) {
+            Completion completion;
+            completion.tag = request.tag;
+
+            std::size_t size = 0;
+            int fd = open_file(request.file, size, completion.error);
+            if (fd >= 0) {
+                completion.data.resize(size);
+                if (!read_all(fd, completion.data)) {
+                    completion.data.clear();
+                    completion.error = "could not read file";
+                }
+
+                ::close(fd);
+            }
+
+            completion.load_ms = elapsed_ms(request.start);
+            completions_.push(std::move(completion));
+        }
+    }
+
+    BlockingQueue<Request> requests_;
+    BlockingQueue<Completion> completions_;
+    std::vector<std::thread> threads_;
+};
+
+#ifdef RECOGNIZER_IO_URING
+
+/**
+ * Loader keeping reads in flight with io_uring.
+ */
+class UringLoader : public Loader {
+public:
+    explicit UringLoader(std::size_t depth)
+            : Loader(depth),
+              ring_(),
+              ready_(),
+              queued_(),
+              orphans_(),
+              initialized_(false),
+              broken_(false)
+    {
+        std::memset(&ring_, 0, sizeof(ring_));
+        initialized_ = !io_uring_queue_init(static_cast<unsigned>(depth),
+                                            &ring_, 0);
+    }
+
+    UringLoader(const UringLoader&) = delete;
+    UringLoader& operator=(const UringLoader&) = delete;
+
+    ~UringLoader() override
+    {
+        // Reads in flight write into their buffers, wait for them
+        Completion completion;
+        while (wait(completion)) {
+        }
+
+        if (initialized_) {
+            io_uring_queue_exit(&ring_);
+        }
+    }
+
+    /**
+     * Whether kernel allowed to create the ring.
+     */
+    bool initialized() const
+    {
+        return initialized_;
+    }
+
+    void submit(std::size_t tag, const std::string& file) override
+    {
+        ++pending_;
+
+        std::unique_ptr<Read> read(new Read());
+        read->completion.tag = tag;
+        read->start = Clock::now();
+
+        std::size_t size = 0;
+        read->fd = open_file(file, size, read->completion.error);
+        if (read->fd < 0) {
+            finish(read.release());
+            return;
+        }
+
+        read->completion.data.resize(size);
+        if (!size) {
+            finish(read.release());
+            return;
+        }
+
+        queue(read.release());
+    }
+
+    bool wait(Completion& completion) override
+    {
+        if (!pending_) {
+            return false;
+        }
+
+        while (ready_.empty()) {
+            io_uring_cqe* cqe = nullptr;
+            int rc = io_uring_wait_cqe(&ring_, &cqe);
+            if (rc == -EINTR) {
+                continue;
+            }
+            if (rc < 0) {
+                // Ring is broken, reads in flight and later ones are
+                // finished with pread
+                broken_ = true;
+                for (Read* read : queued_) {
+                    fall_back(read);
+                }
+                queued_.clear();
+                break;
+            }
+
+            Read* read = static_cast<Read*>(io_uring_cqe_get_data(cqe));
+            int res = cqe->res;
+            io_uring_cqe_seen(&ring_, cqe);
+            queued_.erase(read);
+
+            if (res == -EINTR || res == -EAGAIN) {
+                queue(read);
+            } else if (res <= 0) {
+                read->completion.data.clear();
+                read->completion.error = "could not read file";
+                finish(read);
+            } else {
+                // Short read continues from where it stopped
+                read->done += static_cast<std::size_t>(res);
+                if (read->done < read->completion.data.size()) {
+                    queue(read);
+                } else {
+                    finish(read);
+                }
+            }
+        }
+
+        if (ready_.empty()) {
+            return false;
+        }
+
+        completion = std::move(ready_.back());
+        ready_.pop_back();
+        --pending_;
+
+        return true;
+    }
+
+    const char* name() const override
+    {
+        return "io_uring";
+    }
+
+private:
+    struct Read {
+        Read()
+                : completion(), start(), fd(-1), done(0)
+        {}
+
+        Completion completion;
+        Clock::time_point start;
+        int fd;
+        std::size_t done;
+    };
+
+    /**
+     * Queue read of the rest of file.
+     */
+    void queue(Read* read)
+    {
+        if (broken_) {
+            fall_back(read);
+            return;
+        }
+
+        // Depth bounds reads in flight, so the ring has a free entry
+        io_uring_sqe* sqe = io_uring_get_sqe(&ring_);
+        if (!sqe) {
+            read->completion.data.clear();
+            read->completion.error = "could not queue read";
+            finish(read);
+            return;
+        }
+
+        io_uring_prep_read(sqe, read->fd,
+                           read->completion.data.data() + read->done,
+                           static_cast<unsigned>(
+                                   read->completion.data.size() - read->done),
+                           read->done);
+        io_uring_sqe_set_data(sqe, read);
+        io_uring_submit(&ring_);
+        queued_.insert(read);
+    }
+
+    /**
+     * Read whole file with pread instead of the ring.
+     */
+    void fall_back(Read* read)
+    {
+        // Kernel may still write into buffer of abandoned read
+        std::vector<uchar> buffer(read->completion.data.size());
+        orphans_.push_back(std::move(read->completion.data));
+        read->completion.data = std::move(buffer);
+
+        if (!read_all(read->fd, read->completion.data)) {
+            read->completion.data.clear();
+            read->completion.error = "could not read file";
+        }
+        finish(read);
+    }
+
+    void finish(Read* read)
+    {
+        std::unique_ptr<Read> owner(read);
+        if (owner->fd >= 0) {
+            ::close(owner->fd);
+        }
+
+        owner->completion.load_ms = elapsed_ms(owner->start);
+        ready_.push_back(std::move(owner->completion));
+    }
+
+    io_uring ring_;
+    std::vector<Completion> ready_;
+    // Reads submitted to the ring
+    std::set<Read*> queued_;
+    // Buffers of reads abandoned with the ring
+    std::vector<std::vector<uchar>> orphans_;
+    bool initialized_;
+    bool broken_;
+};
+
+#endif
+
+}
+
+/**
+ * Create loader.
+ */
+std::unique_ptr<Loader>
+Loader::create(std::size_t depth, Backend backend)
+{
+    if (!depth) {
+        depth = 1;
+    }
+
+#ifdef RECOGNIZER_IO_URING
+    if (backend != Backend::pread) {
+        std::unique_ptr<UringLoader> uring(new UringLoader(depth));
+        if (uring->initialized()) {
+            return std::unique_ptr<Loader>(uring.release());
+        }
+    }
+#else
+    (void)backend;
+#endif
+
+    return std::unique_ptr<Loader>(new PreadLoader(depth));
+}
+
+Loader::Loader(std::size_t depth)
+        : depth_(depth),
+          pending_(0)
+{}
+
+Loader::~Loader()
+{}
+
+/**
+ * Number of submitted and not returned reads.
+ */
+std::size_t
+Loader::pending() const
+{
+    return pending_;
+}
+
+/**
+ * Maximum number of reads in flight.
+ */
+std::size_t
+Loader::depth() const
+{
+    return depth_;
+}
+
+/**
+ * Open file for reading and get its size.
+ */
+int
+Loader::open_file(const std::string& file, std::size_t& size,
+                  std::string& error)
+{
+    int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error = "could not open file";
+        return -1;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) || !S_ISREG(st.st_mode)) {
+        ::close(fd);
+        error = "could not open file";
+        return -1;
+    }
+
+    if (st.st_size <= 0) {
+        ::close(fd);
+        error = "empty file";
+        return -1;
+    }
+
+    // Whole file is read once from start to end
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    size = static_cast<std::size_t>(st.st_size);
+
+    return fd;
+}
+
+}
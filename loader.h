@@ -0,0 +1,133 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * @file loader.h
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing asynchronous file loader declaration.
+ */
+
+#ifndef LOADER_H_
+#define LOADER_H_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+namespace recognizer
+{
+
+/**
+ * @brief Class Loader reads whole files with many reads in flight.
+ *
+ * @detailed Loader is driven by one thread: it submits files while
+ * fewer than queue depth reads are pending and waits for completions,
+ * which come in any order. With io_uring one thread keeps all reads in
+ * flight, otherwise a pool of queue depth threads runs pread. Files are
+ * opened synchronously, only reads are asynchronous.
+ */
+
+class Loader {
+public:
+
+    enum class Backend {
+        automatic,
+        uring,
+        pread
+    };
+
+    /**
+     * @brief Finished read.
+     */
+    struct Completion {
+        std::size_t tag = 0;
+        std::vector<uchar> data{};
+        // Empty on success
+        std::string error{};
+        double load_ms = 0.0;
+    };
+
+    /**
+     * @brief Create loader.
+     * @detailed Automatic backend is io_uring if library has been built
+     * with it and kernel allows it, pread pool otherwise.
+     *
+     * @param[in] depth Maximum number of reads in flight.
+     * @param[in] backend Preferred backend.
+     */
+    static std::unique_ptr<Loader> create(std::size_t depth,
+                                          Backend backend = Backend::automatic);
+
+    virtual ~Loader();
+
+    /**
+     * @brief Start reading file.
+     * @detailed Caller keeps pending() below depth().
+     *
+     * @param[in] tag Caller tag returned with completion.
+     * @param[in] file Name of file.
+     */
+    virtual void submit(std::size_t tag, const std::string& file) = 0;
+
+    /**
+     * @brief Wait for next finished read.
+     *
+     * @param[out] completion Finished read.
+     * @return false if no reads are pending.
+     */
+    virtual bool wait(Completion& completion) = 0;
+
+    /**
+     * @brief Name of backend.
+     */
+    virtual const char* name() const = 0;
+
+    /**
+     * @brief Number of submitted and not returned reads.
+     */
+    std::size_t pending() const;
+
+    /**
+     * @brief Maximum number of reads in flight.
+     */
+    std::size_t depth() const;
+
+protected:
+    explicit Loader(std::size_t depth);
+
+    /**
+     * @brief Open file for reading and get its size.
+     *
+     * @return Descriptor, -1 on failure with error set.
+     */
+    static int open_file(const std::string& file, std::size_t& size,
+                         std::string& error);
+
+    std::size_t depth_;
+    std::size_t pending_;
+};
+
+}
+
+#endif // LOADER_H_
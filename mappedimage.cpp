@@ -0,0 +1,183 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * @file mappedimage.cpp
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing memory mapped raster image definition.
+ */
+
+#include <algorithm>
+#include <cctype>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <opencv2/imgproc.hpp>
+
+#include "mappedimage.h"
+
+namespace recognizer
+{
+
+/**
+ * Map raster file.
+ */
+MappedImage::Ptr
+MappedImage::open(const std::string& file)
+{
+    int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return Ptr();
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+        ::close(fd);
+        return Ptr();
+    }
+
+    std::size_t length = static_cast<std::size_t>(st.st_size);
+
+    // Private writable mapping copies pages on write instead of faulting
+    void* address = ::mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (address == MAP_FAILED) {
+        return Ptr();
+    }
+
+    const uchar* data = static_cast<const uchar*>(address);
+    ImageHeader header = ImageHeader::parse(data, length);
+
+    std::size_t row_size = header.raw() ?
+            static_cast<std::size_t>(header.size.width) * header.channels : 0;
+    if (!header.raw() || header.row_step < row_size ||
+        header.pixel_offset > length ||
+        (length - header.pixel_offset) / header.row_step <
+        static_cast<std::size_t>(header.size.height) - 1 ||
+        length - header.pixel_offset -
+        header.row_step * (header.size.height - 1) < row_size) {
+        ::munmap(address, length);
+        return Ptr();
+    }
+
+    // Rows are read once from first to last
+    ::madvise(address, length, MADV_SEQUENTIAL);
+    std::size_t page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    std::size_t start = header.pixel_offset / page * page;
+    ::madvise(static_cast<char*>(address) + start, length - start,
+              MADV_WILLNEED);
+
+    return Ptr(new MappedImage(address, length, header));
+}
+
+/**
+ * Whether file name looks like mappable raster format.
+ */
+bool
+MappedImage::candidate(const std::string& file)
+{
+    std::size_t dot = file.rfind('.');
+    if (dot == std::string::npos) {
+        return false;
+    }
+
+    std::string ext = file.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+
+    return ext == "bmp" || ext == "ppm" || ext == "pgm" || ext == "pnm" ||
+            ext == "tif" || ext == "tiff";
+}
+
+MappedImage::MappedImage(void* address, std::size_t length,
+                         const ImageHeader& header)
+        : address_(address),
+          length_(length),
+          header_(header),
+          pixels_(header.size.height, header.size.width,
+                  CV_8UC(header.channels),
+                  static_cast<char*>(address) + header.pixel_offset,
+                  header.row_step)
+{}
+
+MappedImage::~MappedImage()
+{
+    ::munmap(address_, length_);
+}
+
+/**
+ * Pixel data in file row order.
+ */
+const cv::Mat&
+MappedImage::pixels() const
+{
+    return pixels_;
+}
+
+/**
+ * Whether pixels are ready for recognition.
+ */
+bool
+MappedImage::in_place() const
+{
+    return header_.channels == 3 && !header_.bottom_up;
+}
+
+/**
+ * Three channel top-down image.
+ */
+cv::Mat
+MappedImage::image() const
+{
+    if (in_place()) {
+        return pixels_;
+    }
+
+    cv::Mat image;
+    if (header_.channels == 1) {
+        cv::cvtColor(pixels_, image, cv::COLOR_GRAY2BGR);
+    } else {
+        image = pixels_;
+    }
+
+    if (header_.bottom_up) {
+        cv::Mat flipped;
+        cv::flip(image, flipped, 0);
+        image = flipped;
+    }
+
+    return image;
+}
+
+/**
+ * Header of mapped file.
+ */
+const ImageHeader&
+MappedImage::header() const
+{
+    return header_;
+}
+
+}
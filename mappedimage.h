@@ -0,0 +1,114 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * @file mappedimage.h
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing memory mapped raster image declaration.
+ */
+
+#ifndef MAPPEDIMAGE_H_
+#define MAPPEDIMAGE_H_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include <opencv2/core.hpp>
+
+#include "imageheader.h"
+
+namespace recognizer
+{
+
+/**
+ * @brief Class MappedImage maps uncompressed raster file and wraps its
+ * pixel data as image without copying.
+ *
+ * @detailed Works for 8 bit BMP, PNM and TIFF files whose pixel data
+ * is one block of rows, see ImageHeader. Pages are read by page faults
+ * on first access. Mapping is private, so image may be used as any
+ * other image and writes never reach the file. Image must not outlive
+ * its mapping.
+ */
+
+class MappedImage {
+public:
+    typedef std::shared_ptr<const MappedImage> Ptr;
+
+    /**
+     * @brief Map raster file.
+     *
+     * @param[in] file Name of image file.
+     * @return Mapped image, null if file could not be mapped or its
+     * pixels are not plain raster.
+     */
+    static Ptr open(const std::string& file);
+
+    /**
+     * @brief Whether file name looks like raster format which may be
+     * mapped, so other files don't pay for an attempt.
+     */
+    static bool candidate(const std::string& file);
+
+    MappedImage(const MappedImage&) = delete;
+    MappedImage& operator=(const MappedImage&) = delete;
+
+    ~MappedImage();
+
+    /**
+     * @brief Pixel data in file row order.
+     */
+    const cv::Mat& pixels() const;
+
+    /**
+     * @brief Whether pixels are top-down three channel image ready for
+     * recognition.
+     * @detailed Channel order of PNM and TIFF is RGB instead of BGR,
+     * detection channels don't depend on it.
+     */
+    bool in_place() const;
+
+    /**
+     * @brief Three channel top-down image.
+     * @detailed Pixels themselves if they are in place, converted copy
+     * otherwise.
+     */
+    cv::Mat image() const;
+
+    /**
+     * @brief Header of mapped file.
+     */
+    const ImageHeader& header() const;
+
+private:
+    MappedImage(void* address, std::size_t length,
+                const ImageHeader& header);
+
+    void* address_;
+    std::size_t length_;
+    ImageHeader header_;
+    cv::Mat pixels_;
+};
+
+}
+
+#endif // MAPPEDIMAGE_H_
@@ -0,0 +1,181 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * @file numa.cpp
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing NUMA topology definition.
+ */
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "numa.h"
+
+namespace recognizer
+{
+
+namespace
+{
+
+thread_local std::size_t pinned_node = 0;
+
+}
+
+/**
+ * CPUs of every node with at least one allowed CPU.
+ */
+const std::vector<Numa::Cpus>&
+Numa::nodes()
+{
+    static const std::vector<Cpus> topology = read_nodes();
+    return topology;
+}
+
+/**
+ * Number of nodes.
+ */
+std::size_t
+Numa::count()
+{
+    return nodes().size();
+}
+
+/**
+ * Pin calling thread to CPUs of node.
+ */
+bool
+Numa::pin(std::size_t node)
+{
+    if (node >= count()) {
+        return false;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : nodes()[node]) {
+        CPU_SET(cpu, &set);
+    }
+
+    if (::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set)) {
+        return false;
+    }
+
+    pinned_node = node;
+
+    return true;
+}
+
+/**
+ * Node calling thread has been pinned to.
+ */
+std::size_t
+Numa::thread_node()
+{
+    return pinned_node;
+}
+
+/**
+ * Parse sysfs CPU list.
+ */
+Numa::Cpus
+Numa::parse_cpus(const std::string& list)
+{
+    Cpus cpus;
+    if (list.empty()) {
+        return cpus;
+    }
+
+    std::istringstream in(list);
+    std::string range;
+    while (std::getline(in, range, ',')) {
+        if (range.empty() || range[0] < '0' || range[0] > '9') {
+            continue;
+        }
+
+        char* end = nullptr;
+        long first = std::strtol(range.c_str(), &end, 10);
+        long last = *end == '-' ? std::strtol(end + 1, nullptr, 10) : first;
+
+        for (long cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+    }
+
+    return cpus;
+}
+
+/**
+ * Read topology from sysfs.
+ */
+std::vector<Numa::Cpus>
+Numa::read_nodes()
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (::sched_getaffinity(0, sizeof(allowed), &allowed)) {
+        return std::vector<Cpus>(1);
+    }
+
+    std::vector<Cpus> topology;
+
+    // Online node list has the same format as CPU lists
+    std::ifstream online("/sys/devices/system/node/online");
+    std::string nodes;
+    std::getline(online, nodes);
+
+    for (int node : parse_cpus(nodes)) {
+        std::ifstream file("/sys/devices/system/node/node" +
+                           std::to_string(node) + "/cpulist");
+        std::string list;
+        std::getline(file, list);
+
+        Cpus cpus;
+        for (int cpu : parse_cpus(list)) {
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) {
+                cpus.push_back(cpu);
+            }
+        }
+
+        if (!cpus.empty()) {
+            topology.push_back(cpus);
+        }
+    }
+
+    // No NUMA information, the whole mask is one node
+    if (topology.empty()) {
+        Cpus cpus;
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &allowed)) {
+                cpus.push_back(cpu);
+            }
+        }
+        topology.push_back(cpus);
+    }
+
+    return topology;
+}
+
+}
@@ -0,0 +1,87 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * @file numa.h
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing NUMA topology declaration.
+ */
+
+#ifndef NUMA_H_
+#define NUMA_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace recognizer
+{
+
+/**
+ * @brief Class Numa describes NUMA nodes the process may run on.
+ *
+ * @detailed Topology is read from sysfs once and limited to CPUs of the
+ * process affinity mask. Without NUMA information the whole mask is
+ * one node. Linux places pages on the node of the thread touching them
+ * first, so buffers allocated and filled by a pinned thread are local
+ * to its node.
+ */
+
+class Numa {
+public:
+    typedef std::vector<int> Cpus;
+
+    /**
+     * @brief CPUs of every node with at least one allowed CPU.
+     */
+    static const std::vector<Cpus>& nodes();
+
+    /**
+     * @brief Number of nodes.
+     */
+    static std::size_t count();
+
+    /**
+     * @brief Pin calling thread to CPUs of node.
+     *
+     * @param[in] node Node index in range [0, count()).
+     * @return false if affinity could not be set.
+     */
+    static bool pin(std::size_t node);
+
+    /**
+     * @brief Node calling thread has been pinned to, 0 if it is not
+     * pinned.
+     */
+    static std::size_t thread_node();
+
+    /**
+     * @brief Parse sysfs CPU list like "0-3,8-11".
+     */
+    static Cpus parse_cpus(const std::string& list);
+
+private:
+    static std::vector<Cpus> read_nodes();
+};
+
+}
+
+#endif // NUMA_H_
@@ -0,0 +1,185 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * @file ocrpool.cpp
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing pool of initialized tesseract instances.
+ */
+
+#include <tesseract/baseapi.h>
+
+#include "ocrpool.h"
+#include "numa.h"
+
+namespace recognizer
+{
+
+/**
+ * Ending and destroying tesseract instance.
+ */
+void
+OcrPool::ApiDeleter::operator()(tesseract::TessBaseAPI* api) const
+{
+    api->End();
+    delete api;
+}
+
+/**
+ * Set image on tesseract instance.
+ */
+OcrPool::Page::Page(tesseract::TessBaseAPI& api, const cv::Mat& image)
+        : api_(api)
+{
+    api_.SetImage(static_cast<const uchar*>(static_cast<const void*>(
+                          image.data)),
+                  image.size().width,
+                  image.size().height,
+                  image.channels(),
+                  static_cast<int>(image.step1()));
+}
+
+/**
+ * Drop image and results of recognition.
+ */
+OcrPool::Page::~Page()
+{
+    api_.Clear();
+}
+
+/**
+ * Recognized text of the page.
+ */
+std::string
+OcrPool::Page::text() const
+{
+    TextPtr text(api_.GetUTF8Text());
+    return text ? std::string(text.get()) : std::string();
+}
+
+/**
+ * Create empty pool.
+ */
+OcrPool::OcrPool(const Config& config, const TessData::Ptr& tessdata)
+        : config_(config),
+          tessdata_(tessdata),
+          mutex_(),
+          idle_(Numa::count())
+{}
+
+/**
+ * Lease idle instance or initialize a new one.
+ */
+OcrPool::Lease
+OcrPool::acquire() REC_THROW(RecException)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<ApiPtr>& idle = idle_[Numa::thread_node()];
+        if (!idle.empty()) {
+            ApiPtr api = std::move(idle.back());
+            idle.pop_back();
+            return Lease(*this, std::move(api));
+        }
+    }
+
+    // Initialization is slow, don't hold the lock
+    return Lease(*this, create());
+}
+
+/**
+ * Initialize instances ahead of use.
+ */
+void
+OcrPool::reserve(std::size_t count) REC_THROW(RecException)
+{
+    while (idle() < count) {
+        release(create());
+    }
+}
+
+/**
+ * Number of idle instances.
+ */
+std::size_t
+OcrPool::idle() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::size_t count = 0;
+    for (const std::vector<ApiPtr>& idle : idle_) {
+        count += idle.size();
+    }
+
+    return count;
+}
+
+/**
+ * Initialize tesseract instance.
+ */
+OcrPool::ApiPtr
+OcrPool::create() const REC_THROW(RecException)
+{
+    ApiPtr api(new tesseract::TessBaseAPI());
+
+    // Init tesseract dictionary for configured language
+    tesseract::OcrEngineMode mode = tesseract::OEM_DEFAULT;
+    switch (config_.ocr_engine) {
+    case Config::OcrEngine::legacy:
+        mode = tesseract::OEM_TESSERACT_ONLY;
+        break;
+    case Config::OcrEngine::lstm:
+        mode = tesseract::OEM_LSTM_ONLY;
+        break;
+    case Config::OcrEngine::combined:
+        mode = tesseract::OEM_TESSERACT_LSTM_COMBINED;
+        break;
+    case Config::OcrEngine::automatic:
+        break;
+    }
+
+    // Shared traineddata mapping replaces file lookup and read
+    int rc = tessdata_ ?
+            api->Init(tessdata_->data(), static_cast<int>(tessdata_->size()),
+                      config_.ocr_language.c_str(), mode,
+                      nullptr, 0, nullptr, nullptr, false, nullptr) :
+            api->Init(nullptr, config_.ocr_language.c_str(), mode);
+
+    if (rc) {
+        throw RecException("could not initialize tesseract ocr");
+    }
+
+    return api;
+}
+
+/**
+ * Return instance to pool.
+ */
+void
+OcrPool::release(ApiPtr api)
+{
+    // Drop image and results of the last recognition
+    api->Clear();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    idle_[Numa::thread_node()].push_back(std::move(api));
+}
+
+}
@@ -0,0 +1,186 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * @file ocrpool.h
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing pool of initialized tesseract instances.
+ */
+
+#ifndef OCRPOOL_H_
+#define OCRPOOL_H_
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "config.h"
+#include "tessdata.h"
+#include "recexcept.h"
+
+namespace tesseract
+{
+class TessBaseAPI;
+}
+
+namespace recognizer
+{
+
+/**
+ * @brief Class OcrPool keeps initialized tesseract instances for reuse.
+ *
+ * @detailed Tesseract initialization loads the whole language model,
+ * so instances are initialized once and leased to recognitions one at
+ * a time. Instance leased by a thread is used by this thread only.
+ * Instances initialized before fork are inherited by child processes
+ * copy-on-write. Idle instances are kept per NUMA node of the thread
+ * which released them, so pinned threads lease node-local instances.
+ */
+
+class OcrPool {
+public:
+
+    /**
+     * @brief Deleter ending and destroying tesseract instance.
+     */
+    struct ApiDeleter {
+        void operator()(tesseract::TessBaseAPI* api) const;
+    };
+
+    typedef std::unique_ptr<tesseract::TessBaseAPI, ApiDeleter> ApiPtr;
+
+    /**
+     * @brief Text allocated by tesseract, callers own it and free it
+     * with delete[].
+     */
+    typedef std::unique_ptr<char[]> TextPtr;
+
+    /**
+     * @brief Image set on tesseract instance for one recognition.
+     * @detailed Tesseract copies the image into its own leptonica pix
+     * and keeps it together with recognition results until Clear(), so
+     * the page clears the instance on destruction whatever way the
+     * recognition ends.
+     */
+    class Page {
+    public:
+        Page(tesseract::TessBaseAPI& api, const cv::Mat& image);
+
+        Page(const Page&) = delete;
+        Page& operator=(const Page&) = delete;
+
+        ~Page();
+
+        /**
+         * @brief Recognized text of the page, empty if there is none.
+         */
+        std::string text() const;
+
+    private:
+        tesseract::TessBaseAPI& api_;
+    };
+
+    /**
+     * @brief Leased tesseract instance, returned to pool on destruction.
+     */
+    class Lease {
+    public:
+        Lease(OcrPool& pool, ApiPtr api)
+                : pool_(&pool), api_(std::move(api))
+        {}
+
+        Lease(Lease&& lease) noexcept
+                : pool_(lease.pool_), api_(std::move(lease.api_))
+        {}
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        ~Lease()
+        {
+            if (api_) {
+                pool_->release(std::move(api_));
+            }
+        }
+
+        tesseract::TessBaseAPI* operator->() const
+        {
+            return api_.get();
+        }
+
+        tesseract::TessBaseAPI& operator*() const
+        {
+            return *api_;
+        }
+
+    private:
+        OcrPool* pool_;
+        ApiPtr api_;
+    };
+
+    /**
+     * @brief Create empty pool.
+     *
+     * @param[in] config Ocr language and engine mode.
+     * @param[in] tessdata Mapped traineddata, may be null.
+     */
+    OcrPool(const Config& config, const TessData::Ptr& tessdata);
+
+    OcrPool(const OcrPool&) = delete;
+    OcrPool& operator=(const OcrPool&) = delete;
+
+    /**
+     * @brief Lease idle instance or initialize a new one.
+     * @throw RecException if tesseract could not be initialized.
+     */
+    Lease acquire() REC_THROW(RecException);
+
+    /**
+     * @brief Initialize instances ahead of use.
+     *
+     * @param[in] count Number of idle instances to have.
+     * @throw RecException if tesseract could not be initialized.
+     */
+    void reserve(std::size_t count) REC_THROW(RecException);
+
+    /**
+     * @brief Number of idle instances.
+     */
+    std::size_t idle() const;
+
+private:
+    ApiPtr create() const REC_THROW(RecException);
+    void release(ApiPtr api);
+
+private:
+    const Config config_;
+    const TessData::Ptr tessdata_;
+    mutable std::mutex mutex_;
+    // Idle instances of every NUMA node
+    std::vector<std::vector<ApiPtr>> idle_;
+};
+
+}
+
+#endif // OCRPOOL_H_
@@ -0,0 +1,511 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * @file prefork.cpp
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing pre-fork worker server definition.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <utility>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include <opencv2/imgcodecs.hpp>
+
+#include "prefork.h"
+#include "budget.h"
+
+namespace recognizer
+{
+
+namespace
+{
+
+template <typename T>
+void put(std::string& buf, const T& value)
+{
+    buf.append(static_cast<const char*>(static_cast<const void*>(&value)),
+               sizeof(value));
+}
+
+void put(std::string& buf, const std::string& value)
+{
+    put(buf, static_cast<std::uint32_t>(value.size()));
+    buf.append(value);
+}
+
+template <typename T>
+bool get(const std::string& buf, std::size_t& pos, T& value)
+{
+    if (pos + sizeof(value) > buf.size()) {
+        return false;
+    }
+
+    std::memcpy(&value, buf.data() + pos, sizeof(value));
+    pos += sizeof(value);
+
+    return true;
+}
+
+bool get(const std::string& buf, std::size_t& pos, std::string& value)
+{
+    std::uint32_t len;
+    if (!get(buf, pos, len) || pos + len > buf.size()) {
+        return false;
+    }
+
+    value.assign(buf, pos, len);
+    pos += len;
+
+    return true;
+}
+
+/**
+ * Add resident and proportional set size of process.
+ */
+void
+add_memory(pid_t pid, PreforkServer::Memory& memory)
+{
+    std::ifstream in("/proc/" + std::to_string(pid) + "/smaps_rollup");
+
+    std::string key;
+    double kb;
+    while (in >> key) {
+        if (key == "Rss:" && in >> kb) {
+            memory.rss_mb += kb / 1024.0;
+        } else if (key == "Pss:" && in >> kb) {
+            memory.pss_mb += kb / 1024.0;
+        }
+        in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+}
+
+}
+
+/**
+ * Load models, fork workers and start dispatcher.
+ */
+PreforkServer::PreforkServer(const Options& options, Engine::Callback callback)
+        REC_THROW(RecException)
+        : callback_(std::move(callback)),
+          jobs_(options.queue),
+          workers_(),
+          dispatchers_(),
+          alive_(0),
+          memory_()
+{
+    std::size_t count = options.workers;
+    if (!count) {
+        count = std::thread::hardware_concurrency();
+    }
+    if (!count) {
+        count = 1;
+    }
+
+    // OpenCV and OpenMP thread pools started by warm up wouldn't
+    // survive fork, workers scale by processes
+    ThreadBudget::configure_libraries();
+
+    {
+        Recognizer::Ptr recognizer = Recognizer::create(options.config);
+        recognizer->warm_up(1);
+
+        for (std::size_t w = 0; w < count; ++w) {
+            int fds[2];
+            if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+                finish();
+                throw RecException(std::string("could not create socket: ") +
+                                   std::strerror(errno));
+            }
+
+            pid_t pid = ::fork();
+            if (pid < 0) {
+                int err = errno;
+                ::close(fds[0]);
+                ::close(fds[1]);
+                finish();
+                throw RecException(std::string("could not fork worker: ") +
+                                   std::strerror(err));
+            }
+
+            if (!pid) {
+                // Worker doesn't need sockets of its siblings
+                for (const Worker& worker : workers_) {
+                    ::close(worker.fd);
+                }
+                ::close(fds[0]);
+
+                worker_loop(*recognizer, fds[1]);
+                ::_exit(EXIT_SUCCESS);
+            }
+
+            ::close(fds[1]);
+
+            Worker worker;
+            worker.pid = pid;
+            worker.fd = fds[0];
+            workers_.push_back(worker);
+        }
+    }
+
+    // Threads are started only after the last fork
+    alive_ = workers_.size();
+    for (Worker& worker : workers_) {
+        dispatchers_.emplace_back(&PreforkServer::dispatch_loop, this,
+                                  std::ref(worker));
+    }
+}
+
+PreforkServer::~PreforkServer()
+{
+    finish();
+}
+
+/**
+ * Put job into dispatcher queue.
+ */
+bool
+PreforkServer::submit(Engine::Job job)
+{
+    return jobs_.push(std::move(job));
+}
+
+/**
+ * Process all submitted jobs and stop workers.
+ */
+void
+PreforkServer::finish()
+{
+    jobs_.close();
+    for (std::thread& dispatcher : dispatchers_) {
+        if (dispatcher.joinable()) {
+            dispatcher.join();
+        }
+    }
+
+    // Idle workers hold what the last job left in memory
+    Memory memory;
+    for (const Worker& worker : workers_) {
+        if (worker.pid > 0) {
+            add_memory(worker.pid, memory);
+        }
+    }
+    if (memory.rss_mb > 0.0) {
+        memory_ = memory;
+    }
+
+    // Closed socket tells worker to exit
+    for (Worker& worker : workers_) {
+        if (worker.fd >= 0) {
+            ::close(worker.fd);
+            worker.fd = -1;
+        }
+
+        if (worker.pid > 0) {
+            int status;
+            while (::waitpid(worker.pid, &status, 0) < 0 && errno == EINTR) {
+            }
+            worker.pid = -1;
+        }
+    }
+}
+
+std::size_t
+PreforkServer::workers() const
+{
+    return workers_.size();
+}
+
+/**
+ * Memory of workers measured after the last job.
+ */
+PreforkServer::Memory
+PreforkServer::memory() const
+{
+    return memory_;
+}
+
+/**
+ * Serve requests from parent until socket is closed.
+ */
+void
+PreforkServer::worker_loop(const Recognizer& recognizer, int fd)
+{
+    std::string request;
+    while (read_message(fd, request)) {
+        Engine::Outcome outcome;
+        std::int64_t remaining_ms = -1;
+
+        std::size_t pos = 0;
+        std::uint64_t id = 0;
+        std::string data;
+        if (!get(request, pos, id) || !get(request, pos, remaining_ms) ||
+            !get(request, pos, outcome.file) || !get(request, pos, data)) {
+            return;
+        }
+        outcome.id = static_cast<std::size_t>(id);
+
+        // Negative time means no deadline
+        RequestContext ctx = remaining_ms < 0 ? RequestContext() :
+                RequestContext::timeout(static_cast<long>(remaining_ms));
+
+        // Worker which dies is not replaced, so it survives any error
+        Recognizer::Clock::time_point start = Recognizer::Clock::now();
+        try {
+            cv::Mat image;
+            if (data.empty()) {
+                image = cv::imread(outcome.file, cv::IMREAD_COLOR);
+            } else {
+                image = cv::imdecode(
+                        std::vector<uchar>(data.begin(), data.end()),
+                        cv::IMREAD_COLOR);
+            }
+            outcome.decode_ms = Recognizer::elapsed_ms(start);
+
+            outcome.result = recognizer.recognize(image, ctx);
+        } catch (const RecException& ex) {
+            outcome.error = ex.what();
+        } catch (const cv::Exception& ex) {
+            outcome.error = ex.what();
+        } catch (const std::exception& ex) {
+            outcome.error = ex.what();
+        }
+
+        outcome.total_ms = Recognizer::elapsed_ms(start);
+
+        if (!write_message(fd, encode(outcome))) {
+            return;
+        }
+    }
+}
+
+/**
+ * Send jobs to worker and receive results.
+ */
+void
+PreforkServer::dispatch_loop(Worker& worker)
+{
+    bool alive = true;
+    Engine::Job job;
+
+    while (alive && jobs_.pop(job)) {
+        Recognizer::Clock::time_point start = Recognizer::Clock::now();
+
+        Engine::Outcome outcome;
+        outcome.id = job.id;
+        outcome.file = job.file;
+        outcome.priority = job.priority;
+
+        if (job.context.expired()) {
+            outcome.result.expired = true;
+            outcome.error = "deadline exceeded";
+            report(job, outcome);
+            continue;
+        }
+
+        if (!job.image.empty()) {
+            outcome.error = "decoded images are not sent to worker processes";
+            report(job, outcome);
+            continue;
+        }
+
+        // Zero would mean no deadline to worker, so deadline passing in
+        // flight is sent as the shortest one
+        std::int64_t remaining_ms = -1;
+        if (job.context.has_deadline()) {
+            remaining_ms = std::max<std::int64_t>(
+                    job.context.remaining_ms(), 1);
+        }
+
+        std::string message;
+        put(message, static_cast<std::uint64_t>(job.id));
+        put(message, remaining_ms);
+        put(message, job.file);
+        put(message, std::string(job.data.begin(), job.data.end()));
+
+        std::string reply;
+        if (!write_message(worker.fd, message) ||
+            !read_message(worker.fd, reply) || !decode(reply, outcome)) {
+            outcome.error = "worker process died";
+            alive = false;
+        }
+
+        // Time in dispatcher includes socket round trip
+        outcome.total_ms = Recognizer::elapsed_ms(start);
+        report(job, outcome);
+    }
+
+    // Nobody else will take the jobs if this was the last worker
+    if (alive_.fetch_sub(1) == 1) {
+        while (jobs_.pop(job)) {
+            Engine::Outcome outcome;
+            outcome.id = job.id;
+            outcome.file = std::move(job.file);
+            outcome.priority = job.priority;
+            outcome.error = "no worker processes";
+            report(job, outcome);
+        }
+    }
+}
+
+/**
+ * Report outcome through callback of job or of server.
+ */
+void
+PreforkServer::report(const Engine::Job& job, const Engine::Outcome& outcome)
+{
+    if (job.done) {
+        job.done(outcome);
+    } else if (callback_) {
+        callback_(outcome);
+    }
+}
+
+bool
+PreforkServer::read_full(int fd, void* buf, std::size_t len)
+{
+    char* ptr = static_cast<char*>(buf);
+    while (len) {
+        ssize_t n = ::read(fd, ptr, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            return false;
+        }
+        ptr += n;
+        len -= static_cast<std::size_t>(n);
+    }
+
+    return true;
+}
+
+bool
+PreforkServer::write_full(int fd, const void* buf, std::size_t len)
+{
+    const char* ptr = static_cast<const char*>(buf);
+    while (len) {
+        // Dead peer must not kill the process with SIGPIPE
+        ssize_t n = ::send(fd, ptr, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            return false;
+        }
+        ptr += n;
+        len -= static_cast<std::size_t>(n);
+    }
+
+    return true;
+}
+
+/**
+ * Write length prefixed message.
+ */
+bool
+PreforkServer::write_message(int fd, const std::string& message)
+{
+    std::uint32_t len = static_cast<std::uint32_t>(message.size());
+    return write_full(fd, &len, sizeof(len)) &&
+            write_full(fd, message.data(), message.size());
+}
+
+/**
+ * Read length prefixed message.
+ */
+bool
+PreforkServer::read_message(int fd, std::string& message)
+{
+    std::uint32_t len;
+    if (!read_full(fd, &len, sizeof(len))) {
+        return false;
+    }
+
+    message.resize(len);
+    return !len || read_full(fd, &message[0], len);
+}
+
+/**
+ * Serialize worker result.
+ */
+std::string
+PreforkServer::encode(const Engine::Outcome& outcome)
+{
+    std::string buf;
+    put(buf, outcome.decode_ms);
+    put(buf, outcome.result.detect_ms);
+    put(buf, outcome.result.ocr_ms);
+    put(buf, static_cast<std::uint8_t>(outcome.result.expired));
+    put(buf, outcome.result.text);
+    put(buf, outcome.error);
+
+    put(buf, static_cast<std::uint32_t>(outcome.result.boxes.size()));
+    for (const cv::Rect& r : outcome.result.boxes) {
+        std::int32_t box[] = {r.x, r.y, r.width, r.height};
+        put(buf, box);
+    }
+
+    return buf;
+}
+
+/**
+ * Deserialize worker result.
+ */
+bool
+PreforkServer::decode(const std::string& message, Engine::Outcome& outcome)
+{
+    std::size_t pos = 0;
+    std::uint8_t expired = 0;
+    std::uint32_t boxes = 0;
+
+    if (!get(message, pos, outcome.decode_ms) ||
+        !get(message, pos, outcome.result.detect_ms) ||
+        !get(message, pos, outcome.result.ocr_ms) ||
+        !get(message, pos, expired) ||
+        !get(message, pos, outcome.result.text) ||
+        !get(message, pos, outcome.error) ||
+        !get(message, pos, boxes)) {
+        return false;
+    }
+
+    outcome.result.expired = expired != 0;
+    outcome.result.boxes.clear();
+    for (std::uint32_t b = 0; b < boxes; ++b) {
+        std::int32_t box[4];
+        if (!get(message, pos, box)) {
+            return false;
+        }
+        outcome.result.boxes.push_back(cv::Rect(box[0], box[1],
+                                                box[2], box[3]));
+    }
+
+    return true;
+}
+
+}
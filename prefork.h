@@ -0,0 +1,173 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * @file prefork.h
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing pre-fork worker server declaration.
+ */
+
+#ifndef PREFORK_H_
+#define PREFORK_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+#include <sys/types.h>
+
+#include "engine.h"
+#include "recognizer.h"
+#include "queue.h"
+#include "recexcept.h"
+
+namespace recognizer
+{
+
+/**
+ * @brief Class PreforkServer runs recognition in forked worker processes.
+ *
+ * @detailed Tesseract doesn't scale well with threads inside one
+ * process, so the server scales with processes. Parent loads the
+ * classifiers and tesseract once, warms them with a dummy image and
+ * then forks workers, which inherit initialized state copy-on-write.
+ * Dispatcher in the parent sends every job to an idle worker over a
+ * unix socket and reports result through the callback. Worker that
+ * dies is not replaced, its jobs are reported as failed. Models and
+ * ocr instance initialized by warm up are shared by workers as long as
+ * they don't write to their pages, this is where the server saves
+ * memory compared to a process per worker. Server stops
+ * OpenCV and OpenMP thread pools of the process before warm up, see
+ * ThreadBudget::configure_libraries(), as pools don't survive fork.
+ */
+
+class PreforkServer {
+public:
+
+    /**
+     * @brief Server settings.
+     */
+    struct Options {
+        // Number of worker processes, 0 means number of hardware threads
+        std::size_t workers = 0;
+        // Jobs waiting for an idle worker
+        std::size_t queue = 0;
+        Config config{};
+    };
+
+    /**
+     * @brief Memory of all worker processes.
+     * @detailed Proportional set size splits every shared page between
+     * processes sharing it, so RSS minus PSS is memory saved by sharing
+     * pages of the warmed parent copy-on-write.
+     */
+    struct Memory {
+        double rss_mb = 0.0;
+        double pss_mb = 0.0;
+    };
+
+    /**
+     * @brief Load models, fork workers and start dispatcher.
+     * @detailed Must be created while the process has a single thread,
+     * forked children inherit only the calling thread.
+     *
+     * @param[in] options Server settings.
+     * @param[in] callback Called from dispatcher threads for every job.
+     * @throw RecException if models could not be loaded or workers
+     * could not be started.
+     */
+    PreforkServer(const Options& options, Engine::Callback callback)
+            REC_THROW(RecException);
+
+    PreforkServer(const PreforkServer&) = delete;
+    PreforkServer& operator=(const PreforkServer&) = delete;
+
+    ~PreforkServer();
+
+    /**
+     * @brief Put job into dispatcher queue, wait while queue is full.
+     * @detailed Job is file or encoded image, decoded images can't be
+     * sent to workers and are reported as failed.
+     *
+     * @return false if server has been finished.
+     */
+    bool submit(Engine::Job job);
+
+    /**
+     * @brief Process all submitted jobs and stop workers.
+     */
+    void finish();
+
+    std::size_t workers() const;
+
+    /**
+     * @brief Memory of workers measured by finish() after the last job,
+     * zero before.
+     */
+    Memory memory() const;
+
+private:
+
+    /**
+     * @brief Worker process and parent end of its socket.
+     */
+    struct Worker {
+        pid_t pid = -1;
+        int fd = -1;
+    };
+
+    /**
+     * @brief Serve requests from parent until socket is closed.
+     */
+    static void worker_loop(const Recognizer& recognizer, int fd);
+
+    /**
+     * @brief Send jobs to worker and receive results.
+     */
+    void dispatch_loop(Worker& worker);
+
+    /**
+     * @brief Report outcome through callback of job or of server.
+     */
+    void report(const Engine::Job& job, const Engine::Outcome& outcome);
+
+    static bool read_full(int fd, void* buf, std::size_t len);
+    static bool write_full(int fd, const void* buf, std::size_t len);
+    static bool write_message(int fd, const std::string& message);
+    static bool read_message(int fd, std::string& message);
+
+    static std::string encode(const Engine::Outcome& outcome);
+    static bool decode(const std::string& message, Engine::Outcome& outcome);
+
+private:
+    Engine::Callback callback_;
+    BlockingQueue<Engine::Job> jobs_;
+    std::vector<Worker> workers_;
+    std::vector<std::thread> dispatchers_;
+    // Live dispatchers, the last one reports jobs nobody can process
+    std::atomic<std::size_t> alive_;
+    Memory memory_;
+};
+
+}
+
+#endif // PREFORK_H_
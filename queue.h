@@ -0,0 +1,294 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * @file queue.h
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing bounded blocking queues for engine stages.
+ */
+
+#ifndef QUEUE_H_
+#define QUEUE_H_
+
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+namespace recognizer
+{
+
+/**
+ * @brief Bounded multi-producer multi-consumer blocking queue.
+ * @detailed Producers block while the queue is full, consumers block
+ * while it is empty. After close() producers are rejected and consumers
+ * drain the remaining items and then get false from pop().
+ */
+
+template <typename T>
+class BlockingQueue {
+public:
+    explicit BlockingQueue(std::size_t capacity)
+            : capacity_(capacity ? capacity : 1),
+              items_(),
+              mutex_(),
+              not_empty_(),
+              not_full_(),
+              closed_(false)
+    {}
+
+    BlockingQueue(const BlockingQueue&) = delete;
+    BlockingQueue& operator=(const BlockingQueue&) = delete;
+
+    /**
+     * @brief Put item into queue, wait while queue is full.
+     *
+     * @param[in] item Item to put.
+     * @return false if queue has been closed.
+     */
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this] {
+                return closed_ || items_.size() < capacity_;
+            });
+
+        if (closed_) {
+            return false;
+        }
+
+        items_.push_back(std::move(item));
+        not_empty_.notify_one();
+
+        return true;
+    }
+
+    /**
+     * @brief Get item from queue, wait while queue is empty.
+     *
+     * @param[out] item Extracted item.
+     * @return false if queue has been closed and drained.
+     */
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this] {
+                return closed_ || !items_.empty();
+            });
+
+        if (items_.empty()) {
+            return false;
+        }
+
+        item = std::move(items_.front());
+        items_.pop_front();
+        not_full_.notify_one();
+
+        return true;
+    }
+
+    /**
+     * @brief Reject new items and wake up all waiters.
+     */
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        not_empty_.notify_all();
+        not_full_.notify_all();
+    }
+
+    std::size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return items_.size();
+    }
+
+    std::size_t capacity() const
+    {
+        return capacity_;
+    }
+
+private:
+    const std::size_t capacity_;
+    std::deque<T> items_;
+    mutable std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    bool closed_;
+};
+
+/**
+ * @brief Request priority class.
+ */
+enum class Priority {
+    interactive = 0,
+    background = 1
+};
+
+/**
+ * @brief Bounded blocking queue with interactive and background lanes.
+ * @detailed Each lane has its own capacity, so a full background lane
+ * never blocks interactive producers. Consumers take interactive items
+ * first, but while both lanes are not empty background lane gets the
+ * configured share of pops, so it doesn't starve.
+ */
+
+template <typename T>
+class PriorityQueue {
+public:
+    PriorityQueue(std::size_t capacity, double background_share)
+            : capacity_(capacity ? capacity : 1),
+              share_(background_share < 0.0 ? 0.0 :
+                     (background_share > 1.0 ? 1.0 : background_share)),
+              lanes_(),
+              mutex_(),
+              not_empty_(),
+              not_full_(),
+              credit_(0.0),
+              closed_(false)
+    {}
+
+    PriorityQueue(const PriorityQueue&) = delete;
+    PriorityQueue& operator=(const PriorityQueue&) = delete;
+
+    /**
+     * @brief Put item into lane, wait while lane is full.
+     *
+     * @param[in] item Item to put.
+     * @param[in] priority Lane of item.
+     * @return false if queue has been closed.
+     */
+    bool push(T item, Priority priority)
+    {
+        std::size_t lane = static_cast<std::size_t>(priority);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_[lane].wait(lock, [this, lane] {
+                return closed_ || lanes_[lane].size() < capacity_;
+            });
+
+        if (closed_) {
+            return false;
+        }
+
+        lanes_[lane].push_back(std::move(item));
+        not_empty_.notify_one();
+
+        return true;
+    }
+
+    /**
+     * @brief Get item, wait while both lanes are empty.
+     *
+     * @param[out] item Extracted item.
+     * @param[out] priority Lane of extracted item, may be null.
+     * @return false if queue has been closed and drained.
+     */
+    bool pop(T& item, Priority* priority = nullptr)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this] {
+                return closed_ || !lanes_[0].empty() || !lanes_[1].empty();
+            });
+
+        return take(item, priority);
+    }
+
+    /**
+     * @brief Get item if there is one, don't wait.
+     *
+     * @param[out] item Extracted item.
+     * @param[out] priority Lane of extracted item, may be null.
+     * @return false if both lanes are empty.
+     */
+    bool try_pop(T& item, Priority* priority = nullptr)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return take(item, priority);
+    }
+
+    /**
+     * @brief Reject new items and wake up all waiters.
+     */
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        not_empty_.notify_all();
+        not_full_[0].notify_all();
+        not_full_[1].notify_all();
+    }
+
+    std::size_t size(Priority priority) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return lanes_[static_cast<std::size_t>(priority)].size();
+    }
+
+private:
+    /**
+     * Extract item from lane chosen by weights, called under lock.
+     */
+    bool take(T& item, Priority* priority)
+    {
+        std::size_t lane;
+        if (lanes_[0].empty() && lanes_[1].empty()) {
+            return false;
+        } else if (lanes_[1].empty()) {
+            lane = 0;
+        } else if (lanes_[0].empty()) {
+            lane = 1;
+        } else {
+            // Weighted round robin while both lanes are busy
+            credit_ += share_;
+            if (credit_ >= 1.0) {
+                credit_ -= 1.0;
+                lane = 1;
+            } else {
+                lane = 0;
+            }
+        }
+
+        item = std::move(lanes_[lane].front());
+        lanes_[lane].pop_front();
+        not_full_[lane].notify_one();
+
+        if (priority) {
+            *priority = static_cast<Priority>(lane);
+        }
+
+        return true;
+    }
+
+private:
+    const std::size_t capacity_;
+    const double share_;
+    std::deque<T> lanes_[2];
+    mutable std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_[2];
+    double credit_;
+    bool closed_;
+};
+
+}
+
+#endif // QUEUE_H_
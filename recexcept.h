@@ -29,6 +29,17 @@ THE SOFTWARE.
 
 #include <exception>
 #include <string>
+
+/**
+ * Dynamic exception specification, removed in C++17. Library is built
+ * as C++11, newer clients see declarations without specification.
+ */
+#if __cplusplus >= 201703L
+#define REC_THROW(...)
+#else
+#define REC_THROW(...) throw (__VA_ARGS__)
+#endif
+
 namespace recognizer
 {
 
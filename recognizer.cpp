@@ -21,18 +21,23 @@ THE SOFTWARE.
  * @file recogizer.cpp
  * @author Alexander Bezsilko
  * @date 4 Nov 2014
- * @brief File containing recognizer static methods and types definitions.
+ * @brief File containing recognizer methods and types definitions.
  */
 
 #include <cstddef>
 #include <memory>
+#include <mutex>
 #include <algorithm>
 #include <iostream>
 
 #include <tesseract/baseapi.h>
+#include <tesseract/ocrclass.h>
 #include <leptonica/allheaders.h>
 
 #include "recognizer.h"
+#include "mappedimage.h"
+#include "budget.h"
+#include "embedded_models.h"
 
 namespace recognizer
 {
@@ -41,96 +46,369 @@ namespace recognizer
  * Recognizer public interface.
  */
 std::string
-Recognizer::get_text(const std::string& file) throw (RecException)
+Recognizer::get_text(const std::string& file) REC_THROW(RecException)
 {
     if (file.empty()) {
         throw RecException("bad file name");
     }
 
+    // Uncompressed rasters are used without reading and decoding
+    MappedImage::Ptr mapped = MappedImage::candidate(file) ?
+            MappedImage::open(file) : MappedImage::Ptr();
+    if (mapped) {
+        return get_text(mapped->image());
+    }
+
     cv::Mat image = cv::imread(file);
 
     return get_text(image);
 }
 
+/**
+ * Create recognizer with immutable configuration.
+ */
+Recognizer::Recognizer(const Config& config) REC_THROW(RecException)
+        : config_(config),
+          classifierNM1_(),
+          classifierNM2_(),
+          classifierGrouping_(config.classifier_grouping),
+          tessdata_(),
+          ocr_pool_()
+{
+    if (!config_.tessdata_file.empty()) {
+        tessdata_ = TessData::load(config_.tessdata_file);
+    }
+
+    ocr_pool_.reset(new OcrPool(config_, tessdata_));
+
+    try {
+        classifierNM1_ =
+                config_.classifier_nm1 == RECOGNIZER_EMBEDDED_MODEL ?
+                EmbeddedModels::classifier_nm1() :
+                cv::text::loadClassifierNM1(config_.classifier_nm1);
+        classifierNM2_ =
+                config_.classifier_nm2 == RECOGNIZER_EMBEDDED_MODEL ?
+                EmbeddedModels::classifier_nm2() :
+                cv::text::loadClassifierNM2(config_.classifier_nm2);
+
+        if (classifierGrouping_ == RECOGNIZER_EMBEDDED_MODEL) {
+            classifierGrouping_ = EmbeddedModels::grouping_file();
+        }
+    } catch (const cv::Exception& ex) {
+        throw RecException(ex.what());
+    }
+
+    if (!classifierNM1_ || !classifierNM2_) {
+        throw RecException("could not load classifiers");
+    }
+
+    // Ocr instances are created lazily, so check traineddata now
+    ocr_pool_->reserve(1);
+}
+
+/**
+ * Create shared recognizer.
+ */
+Recognizer::Ptr
+Recognizer::create(const Config& config) REC_THROW(RecException)
+{
+    return std::make_shared<const Recognizer>(config);
+}
+
+/**
+ * Recognizer used by static interface.
+ */
+Recognizer::Ptr
+Recognizer::instance() REC_THROW(RecException)
+{
+    Ptr current = std::atomic_load(&instance_);
+    if (current) {
+        return current;
+    }
+
+    // Concurrent first callers may both load, only one instance wins
+    Ptr created = create();
+    if (std::atomic_compare_exchange_strong(&instance_, &current, created)) {
+        return created;
+    }
+
+    return current;
+}
+
+/**
+ * Initialize models ahead of first request.
+ */
+void
+Recognizer::warm_up(std::size_t ocr_instances) const REC_THROW(RecException)
+{
+    // Dummy text image runs channels, ER filters and grouping once
+    cv::Mat image(96, 320, CV_8UC3, cv::Scalar(255, 255, 255));
+    cv::putText(image, "Warm up 0123", cv::Point(10, 60),
+                cv::FONT_HERSHEY_SIMPLEX, 1.2, cv::Scalar(0, 0, 0), 3);
+    recognize(image);
+
+    ocr_pool_->reserve(ocr_instances);
+}
+
+/**
+ * Configuration of recognizer.
+ */
+const Config&
+Recognizer::config() const
+{
+    return config_;
+}
+
 /**
  * Recognizer public interface.
  */
 std::string
-Recognizer::get_text(const cv::Mat& image) throw (RecException)
+Recognizer::get_text(const cv::Mat& image) REC_THROW(RecException)
+{
+    return instance()->recognize(image).text;
+}
+
+/**
+ * Recognizer public interface.
+ */
+Recognizer::Result
+Recognizer::recognize(const cv::Mat& image, const RequestContext& ctx) const
+        REC_THROW(RecException)
+{
+    return recognize(image, AreaCallback(), ctx);
+}
+
+/**
+ * Recognizer public interface with progressive results.
+ */
+Recognizer::Result
+Recognizer::recognize(const cv::Mat& image, const AreaCallback& on_area,
+                      const RequestContext& ctx) const
+        REC_THROW(RecException)
 {
     if (image.empty()) {
         throw RecException("failed to load image");
     }
 
-    BoxesGroups boxes_groups = find_text_rects(image);
+    Result result;
+    Clock::time_point start = Clock::now();
+
+    BoxesGroups boxes_groups = detect(image, ctx);
+    result.detect_ms = elapsed_ms(start);
+
     if (!boxes_groups.size()) {
-        return std::string();
+        result.expired = ctx.expired();
+        return result;
     }
 
-    remove_dup(boxes_groups);
+    if (!on_area) {
+        start = Clock::now();
+        TextAreas text_areas = create_text_areas(image, boxes_groups);
+        result.text = alphabet_analisis(text_areas, ctx);
+        result.ocr_ms = elapsed_ms(start);
+        result.expired = ctx.expired();
+        result.boxes = std::move(boxes_groups);
+
+        return result;
+    }
+
+    // First reported areas are the first ones to read
+    reading_order(boxes_groups);
+
+    start = Clock::now();
     TextAreas text_areas = create_text_areas(image, boxes_groups);
+    bool whole = covers_image(image, boxes_groups);
+
+    TextCallback done = [&](std::size_t a, const std::string& text) {
+            if (text.empty()) {
+                return;
+            }
+
+            Area area;
+            area.text = text;
+            area.box = whole ? cv::Rect(0, 0, image.cols, image.rows) :
+                    boxes_groups[a];
+            area.index = a;
+            on_area(area);
+        };
+
+    result.text = join(recognize_texts(text_areas, ctx, done));
+    result.ocr_ms = elapsed_ms(start);
+    result.expired = ctx.expired();
+    result.boxes = std::move(boxes_groups);
 
-    return alphabet_analisis(text_areas);
+    return result;
 }
 
 /**
- * Find rectangles containing characters.
- */    
+ * Find text areas of image without recognizing them.
+ */
 Recognizer::BoxesGroups
-Recognizer::find_text_rects(const cv::Mat& image)
+Recognizer::detect(const cv::Mat& image, const RequestContext& ctx) const
+        REC_THROW(RecException)
 {
-    Channels channels;
-    cv::text::computeNMChannels(image, channels);
-
-    std::size_t cn = channels.size();
-    for (std::size_t c = 0; c < cn - 1; ++c) {
-        channels.push_back(max_channel_ - channels[c]);
+    if (image.empty()) {
+        throw RecException("failed to load image");
     }
 
     BoxesGroups boxes_groups;
+    double scale = config_.detection_scale;
+    if (scale > 0.0 && scale < 1.0) {
+        cv::Mat small;
+        cv::resize(image, small, cv::Size(), scale, scale, cv::INTER_AREA);
+        boxes_groups = find_text_rects(small, ctx);
+
+        // Map boxes back to source image, ocr reads full resolution
+        cv::Rect bounds(0, 0, image.cols, image.rows);
+        for (cv::Rect& r : boxes_groups) {
+            r = cv::Rect(static_cast<int>(r.x / scale),
+                         static_cast<int>(r.y / scale),
+                         static_cast<int>(r.width / scale + 1.0),
+                         static_cast<int>(r.height / scale + 1.0)) & bounds;
+        }
+    } else {
+        boxes_groups = find_text_rects(image, ctx);
+    }
 
-    try {
-        // Creating external filtrs for 1nd stage classifier of N&M algorithm
-        ERFilterPtr er_filter1 =
-                cv::text::createERFilterNM1(
-                    cv::text::loadClassifierNM1(classifierNM1_),
-                    16,
-                    0.00015f,
-                    0.13f,
-                    0.2f,
-                    true,
-                    0.1f);
-        // Creating external filtrs for 2nd stage classifier of N&M algorithm
-        ERFilterPtr er_filter2 =
-                cv::text::createERFilterNM2(
-                    cv::text::loadClassifierNM2(classifierNM2_),
-                    0.5);
-
-        if (!er_filter1 || !er_filter2) {
-            throw RecException("could not create external region filters");
+    remove_dup(boxes_groups);
+
+    return boxes_groups;
+}
+
+/**
+ * Recognize text of given areas of image.
+ */
+Recognizer::Text
+Recognizer::recognize_areas(const cv::Mat& image, const BoxesGroups& boxes,
+                            const RequestContext& ctx) const
+        REC_THROW(RecException)
+{
+    if (image.empty()) {
+        throw RecException("failed to load image");
+    }
+
+    cv::Rect bounds(0, 0, image.cols, image.rows);
+
+    TextAreas text_areas;
+    for (const cv::Rect& r : boxes) {
+        cv::Rect box = r & bounds;
+        if (!box.area()) {
+            throw RecException("text area is outside of image");
         }
+        text_areas.push_back(create_text_area(image, box));
+    }
+
+    return recognize_texts(text_areas, ctx);
+}
+
+/**
+ * Sort text areas in reading order.
+ */
+void
+Recognizer::reading_order(BoxesGroups& boxes)
+{
+    std::stable_sort(boxes.begin(), boxes.end(),
+                     [](const cv::Rect& a, const cv::Rect& b) {
+                         return a.y < b.y;
+                     });
+
+    // Area whose middle is above the bottom of line continues it
+    BoxesGroups::iterator line = boxes.begin();
+    while (line != boxes.end()) {
+        int bottom = line->br().y;
+        BoxesGroups::iterator end = line + 1;
+        while (end != boxes.end() && end->y + end->height / 2 < bottom) {
+            bottom = std::max(bottom, end->br().y);
+            ++end;
+        }
+
+        std::stable_sort(line, end, [](const cv::Rect& a, const cv::Rect& b) {
+                             return a.x < b.x;
+                         });
+        line = end;
+    }
+}
+
+/**
+ * Milliseconds passed since the time point.
+ */
+double
+Recognizer::elapsed_ms(const Clock::time_point& start)
+{
+    return std::chrono::duration<double, std::milli>(
+        Clock::now() - start).count();
+}
+
+/**
+ * Find rectangles containing characters.
+ */    
+Recognizer::BoxesGroups
+Recognizer::find_text_rects(const cv::Mat& image,
+                            const RequestContext& ctx) const
+{
+    const Config& config = config_;
+    Channels channels = compute_channels(image, config.channels);
+
+    BoxesGroups boxes_groups;
 
+    try {
         // Apply the default cascade classifier to each
-        // independent channel (could be done in parallel)    
-        cn = channels.size();
+        // independent channel, in parallel on spare request threads
+        std::size_t cn = channels.size();
         Regions regions(cn);
-        for (std::size_t c = 0; c < cn; ++c) {
-            er_filter1->run(channels[c], regions[c]);
-            er_filter2->run(channels[c], regions[c]);
+
+        const std::shared_ptr<ThreadBudget>& budget = ctx.budget();
+        if (budget && budget->spare(ctx.split())) {
+            budget->parallel_for(cn, [&](std::size_t c) {
+                if (ctx.expired()) {
+                    return;
+                }
+
+                // Filters keep per run state, so each channel gets its own
+                ERFilterPtr er_filter1 = create_filter_nm1();
+                ERFilterPtr er_filter2 = create_filter_nm2();
+                er_filter1->run(channels[c], regions[c]);
+                er_filter2->run(channels[c], regions[c]);
+            }, ctx.split());
+        } else {
+            // Filters keep per run state, loaded classifiers are shared
+            ERFilterPtr er_filter1 = create_filter_nm1();
+            ERFilterPtr er_filter2 = create_filter_nm2();
+
+            for (std::size_t c = 0; c < cn; ++c) {
+                if (ctx.expired()) {
+                    return boxes_groups;
+                }
+
+                er_filter1->run(channels[c], regions[c]);
+                er_filter2->run(channels[c], regions[c]);
+            }
         }
 
         // Detect character groups    
         RegionGroups region_groups;
 
+        if (ctx.expired()) {
+            return boxes_groups;
+        }
 
-        cv::text::erGrouping(image,
-                             channels,
-                             regions,
-                             region_groups,
-                             boxes_groups,
-                             cv::text::ERGROUPING_ORIENTATION_ANY,
-                             classifierGrouping_,
-                             0.5);
+        if (config.grouping == Config::Grouping::horizontal) {
+            cv::text::erGrouping(image,
+                                 channels,
+                                 regions,
+                                 region_groups,
+                                 boxes_groups,
+                                 cv::text::ERGROUPING_ORIENTATION_HORIZ);
+        } else {
+            cv::text::erGrouping(image,
+                                 channels,
+                                 regions,
+                                 region_groups,
+                                 boxes_groups,
+                                 cv::text::ERGROUPING_ORIENTATION_ANY,
+                                 classifierGrouping_,
+                                 config.grouping_min_probability);
+        }
 
     return boxes_groups;
     
@@ -139,6 +417,78 @@ Recognizer::find_text_rects(const cv::Mat& image)
     }
 }
 
+/**
+ * Create external filter for 1st stage classifier of N&M algorithm.
+ */
+Recognizer::ERFilterPtr
+Recognizer::create_filter_nm1() const REC_THROW(RecException)
+{
+    ERFilterPtr filter = cv::text::createERFilterNM1(
+            classifierNM1_,
+            config_.threshold_delta,
+            config_.min_area,
+            config_.max_area,
+            config_.min_probability,
+            config_.non_max_suppression,
+            config_.min_probability_diff);
+
+    if (!filter) {
+        throw RecException("could not create external region filters");
+    }
+
+    return filter;
+}
+
+/**
+ * Create external filter for 2nd stage classifier of N&M algorithm.
+ */
+Recognizer::ERFilterPtr
+Recognizer::create_filter_nm2() const REC_THROW(RecException)
+{
+    ERFilterPtr filter = cv::text::createERFilterNM2(
+            classifierNM2_,
+            config_.nm2_min_probability);
+
+    if (!filter) {
+        throw RecException("could not create external region filters");
+    }
+
+    return filter;
+}
+
+/**
+ * Compute channels for ER filters.
+ */
+Recognizer::Channels
+Recognizer::compute_channels(const cv::Mat& image, Config::Channels set)
+{
+    Channels channels;
+    cv::text::computeNMChannels(image, channels);
+
+    std::size_t cn = channels.size();
+
+    switch (set) {
+    case Config::Channels::luminance:
+        {
+            // Lightness is the fourth of R, G, B, L, gradient channels
+            cv::Mat lightness = channels[3];
+            channels.clear();
+            channels.push_back(lightness);
+            channels.push_back(max_channel_ - lightness);
+        }
+        break;
+    case Config::Channels::all:
+        break;
+    case Config::Channels::all_inverted:
+        for (std::size_t c = 0; c < cn - 1; ++c) {
+            channels.push_back(max_channel_ - channels[c]);
+        }
+        break;
+    }
+
+    return channels;
+}
+
 /**
  * Removing duplicate rectangles.
  */        
@@ -202,73 +552,160 @@ Recognizer::remove_dup(BoxesGroups& boxes)
 Recognizer::TextAreas
 Recognizer::create_text_areas(const cv::Mat& image, const BoxesGroups& boxes)
 {
-    int sum_area = 0;
-    for (const cv::Rect& r : boxes) {
-        sum_area += r.area();
-    }
-
     TextAreas text_areas;
 
-    if (sum_area >= (image.size().area() / 2)) {
+    if (covers_image(image, boxes)) {
         cv::Mat gray;
         cv::cvtColor(image, gray, CV_RGB2GRAY, 0);
         text_areas.push_back(gray);
     } else {
         for (const cv::Rect& r : boxes) {
-            cv::Mat gray, bw;
-            cv::cvtColor(cv::Mat(image, r), gray, CV_RGB2GRAY, 0);
-            cv::threshold(gray, bw, 127.5f, max_channel_, cv::THRESH_OTSU);
-            text_areas.push_back(bw);
+            text_areas.push_back(create_text_area(image, r));
         }
     }
 
     return text_areas;
 }
 
+/**
+ * Whether boxes cover most of image.
+ */
+bool
+Recognizer::covers_image(const cv::Mat& image, const BoxesGroups& boxes)
+{
+    int sum_area = 0;
+    for (const cv::Rect& r : boxes) {
+        sum_area += r.area();
+    }
+
+    return sum_area >= (image.size().area() / 2);
+}
+
+/**
+ * Create binarized image piece of one text area.
+ */
+cv::Mat
+Recognizer::create_text_area(const cv::Mat& image, const cv::Rect& box)
+{
+    cv::Mat gray, bw;
+    cv::cvtColor(cv::Mat(image, box), gray, CV_RGB2GRAY, 0);
+    cv::threshold(gray, bw, 127.5f, max_channel_, cv::THRESH_OTSU);
+
+    return bw;
+}
+
 /**
  * Recognize preprocessed images for characters using tesseract ocr.
  */        
 std::string
-Recognizer::alphabet_analisis(const Recognizer::TextAreas& areas)
+Recognizer::alphabet_analisis(const Recognizer::TextAreas& areas,
+                              const RequestContext& ctx) const
 {
-    Text rec_text;
-    std::unique_ptr<tesseract::TessBaseAPI>
-            ocr(new tesseract::TessBaseAPI());
-
-    // Init tesseract dictionary for English language
-    if (ocr->Init(nullptr, "eng", tesseract::OEM_DEFAULT)) {
-        throw RecException("could not initialize tesseract ocr");
-    }
-
-    // Step by step recognize text areas
-    for (const cv::Mat& area : areas) {
-        ocr->SetImage(static_cast<uchar*>(static_cast<void*>(area.data)),
-                      area.size().width,
-                      area.size().height,
-                      area.channels(),
-                      area.step1());
-        
-        if (!ocr->Recognize(0)) {
+    // Texts are joined in areas order whatever order they finished in
+    return join(recognize_texts(areas, ctx));
+        //    return normalize_result(rec_text);
+}
+
+/**
+ * Join not empty texts of areas.
+ */
+std::string
+Recognizer::join(const Text& text)
+{
+    std::string result;
+    for (const std::string& s : text) {
+        if (!s.empty()) {
+            result.append(s).append(1, ' ');
+        }
+    }
+
+    return result;
+}
 
-            // Processing recognize result for trash characters elimination
-            std::string res = string_processing(ocr->GetUTF8Text());
-            if (!res.empty()) {
-                rec_text.push_back(res);
+/**
+ * Recognize every preprocessed image.
+ */
+Recognizer::Text
+Recognizer::recognize_texts(const TextAreas& areas, const RequestContext& ctx,
+                            const TextCallback& done) const
+{
+    Text rec_text(areas.size());
+
+    const std::shared_ptr<ThreadBudget>& budget = ctx.budget();
+    if (areas.size() > 1 && budget && budget->spare(ctx.split())) {
+        // Finished areas are reported once all areas before them are
+        std::mutex done_mutex;
+        std::vector<bool> finished(areas.size(), false);
+        std::size_t reported = 0;
+
+        // Areas are independent, each lane leases its own instance
+        budget->parallel_for(areas.size(), [&](std::size_t a) {
+            OcrPool::Lease ocr = ocr_pool_->acquire();
+            rec_text[a] = recognize_area(*ocr, areas[a], ctx);
+
+            if (done) {
+                std::lock_guard<std::mutex> lock(done_mutex);
+                finished[a] = true;
+                for (; reported < areas.size() && finished[reported];
+                     ++reported) {
+                    done(reported, rec_text[reported]);
+                }
+            }
+        }, ctx.split());
+    } else {
+        // Initialized instance is reused by later recognitions
+        OcrPool::Lease ocr = ocr_pool_->acquire();
+
+        // Step by step recognize text areas
+        for (std::size_t a = 0; a < areas.size(); ++a) {
+            rec_text[a] = recognize_area(*ocr, areas[a], ctx);
+
+            if (done) {
+                done(a, rec_text[a]);
             }
         }
+    }
 
-        ocr->Clear();
+    return rec_text;
+}
+
+/**
+ * Recognize one text area.
+ */
+std::string
+Recognizer::recognize_area(tesseract::TessBaseAPI& ocr, const cv::Mat& area,
+                           const RequestContext& ctx) const
+{
+    if (ctx.expired()) {
+        return std::string();
     }
 
-    ocr->End();
+    // Tesseract polls monitor while recognizing and stops on cancel
+    ETEXT_DESC monitor;
+    monitor.cancel = &Recognizer::cancel_ocr;
+    monitor.cancel_this = const_cast<RequestContext*>(&ctx);
 
-    std::string result;
-    for (const std::string& s : rec_text) {
-        result.append(s).append(1, ' ');
+    if (ctx.has_deadline()) {
+        monitor.set_deadline_msecs(static_cast<int>(ctx.remaining_ms()));
     }
 
-    return result;
-        //    return normalize_result(rec_text);
+    // Page owns tesseract image and results of this area
+    OcrPool::Page page(ocr, area);
+    if (ocr.Recognize(&monitor)) {
+        return std::string();
+    }
+
+    // Processing recognize result for trash characters elimination
+    return string_processing(page.text());
+}
+
+/**
+ * Tesseract monitor callback for request cancellation.
+ */
+bool
+Recognizer::cancel_ocr(void* cancel_this, int /* words */)
+{
+    return static_cast<const RequestContext*>(cancel_this)->expired();
 }
 
 /**
@@ -351,31 +788,19 @@ std::string Recognizer::normalize_result(const Text& text)
  * Set full paths to algorithm classifiers.
  */
 void Recognizer::set_classifiers(const std::string& classifierNM1,
-                            const std::string& classifierNM2,
-                            const std::string& classifierGrouping)
+                                 const std::string& classifierNM2,
+                                 const std::string& classifierGrouping)
+        REC_THROW(RecException)
 {
-    classifierNM1_ = classifierNM1;
-    classifierNM2_ = classifierNM2;
-    classifierGrouping_ = classifierGrouping;
+    Config config;
+    config.classifier_nm1 = classifierNM1;
+    config.classifier_nm2 = classifierNM2;
+    config.classifier_grouping = classifierGrouping;
+
+    std::atomic_store(&instance_, create(config));
 }
 
 const uchar Recognizer::max_channel_ = 255;
 
-std::string Recognizer::classifierNM1_ =
-        "trained_classifierNM1.xml";
-
-std::string Recognizer::classifierNM2_ =
-        "trained_classifierNM2.xml";
-
-std::string Recognizer::classifierGrouping_ =
-        "trained_classifier_erGrouping.xml";
+Recognizer::Ptr Recognizer::instance_;
 }
-
-
-
-
-
-
-
-
-
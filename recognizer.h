@@ -21,7 +21,7 @@ THE SOFTWARE.
  * @file recogizer.h
  * @author Alexander Bezsilko
  * @date 4 Nov 2014
- * @brief File containing recognizer static methods and types declaration.
+ * @brief File containing recognizer methods and types declaration.
  */
 
 #ifndef RECOGNIZER_H_
@@ -38,8 +38,15 @@ THE SOFTWARE.
 #include <iostream>
 #include <iomanip>
 #include <string>
+#include <chrono>
+#include <memory>
+#include <functional>
 
 #include "recexcept.h"
+#include "context.h"
+#include "config.h"
+#include "tessdata.h"
+#include "ocrpool.h"
 
 namespace recognizer
 {
@@ -52,7 +59,10 @@ namespace recognizer
  * @detailed Recognizer using OpenCV library for detecting
  * image areas that contained characters and pass then to
  * tesseract ocr library for recognition to machine data
- * representation.
+ * representation. Instance is immutable after construction and
+ * may be shared by threads, instances with different models may
+ * run concurrently. Initialized tesseract instances are pooled and
+ * reused between recognitions.
  */
 
 class Recognizer {
@@ -69,6 +79,30 @@ public:
     typedef std::vector<std::vector<cv::text::ERStat>> Regions;
     typedef std::vector<std::vector<cv::Vec2i>> RegionGroups;
     typedef std::vector<cv::Rect> BoxesGroups;    
+    typedef std::chrono::steady_clock Clock;
+
+    /**
+     * @brief Recognition result with found text areas and stage timings.
+     */
+    struct Result {
+        std::string text{};
+        BoxesGroups boxes{};
+        double detect_ms = 0.0;
+        double ocr_ms = 0.0;
+        bool expired = false;
+    };
+
+    /**
+     * @brief Text area reported as soon as it has been recognized.
+     */
+    struct Area {
+        std::string text{};
+        cv::Rect box{};
+        // Position of area in reading order
+        std::size_t index = 0;
+    };
+
+    typedef std::function<void(const Area&)> AreaCallback;
 
     /**
      * @brief Recognizer public interface.
@@ -80,7 +114,7 @@ public:
      * empty string on failure.
      * @throw RecException if occured critical error.
      */
-    static std::string get_text(const std::string& file) throw (RecException);
+    static std::string get_text(const std::string& file) REC_THROW(RecException);
 
     /**
      * @brief Recognizer public interface.
@@ -92,20 +126,154 @@ public:
      * empty string on failure.
      * @throw RecException if occured critical error.
      */    
-    static std::string get_text(const cv::Mat& image) throw (RecException);
+    static std::string get_text(const cv::Mat& image) REC_THROW(RecException);
+
+    typedef std::shared_ptr<const Recognizer> Ptr;
+
+    /**
+     * @brief Create recognizer with immutable configuration.
+     * @detailed Classifiers are loaded once here and shared by all
+     * recognitions, so one instance may be used from many threads. One
+     * ocr instance is initialized, so traineddata which doesn't support
+     * the ocr engine fails here rather than on the first image.
+     *
+     * @param[in] config Detection, ocr and classifier settings.
+     * @throw RecException if classifiers could not be loaded or ocr
+     * could not be initialized.
+     */
+    explicit Recognizer(const Config& config = Config()) REC_THROW(RecException);
+
+    Recognizer(const Recognizer&) = delete;
+    Recognizer& operator=(const Recognizer&) = delete;
+
+    /**
+     * @brief Create shared recognizer.
+     *
+     * @param[in] config Detection, ocr and classifier settings.
+     * @return Recognizer owned by shared pointer.
+     * @throw RecException if classifiers could not be loaded.
+     */
+    static Ptr create(const Config& config = Config()) REC_THROW(RecException);
+
+    /**
+     * @brief Recognizer used by static interface.
+     * @detailed Created with default config on first use and replaced
+     * by set_classifiers. Callers keep the returned instance alive for
+     * the whole recognition, so replacing it never races with them.
+     */
+    static Ptr instance() REC_THROW(RecException);
+
+    /**
+     * @brief Recognizer public interface.
+     * @detailed Same as get_text but also returns rectangles of
+     * recognized text areas and time spent in detection and ocr stages.
+     * Stops as soon as request deadline passes or request is cancelled.
+     * Expired result is marked and contains text recognized before
+     * expiration.
+     *
+     * @param[in] image OpenCV matrix image representation.
+     * @param[in] ctx Request deadline and cancel token.
+     * @return Recognition result, may be partial.
+     * @throw RecException if occured critical error.
+     */
+    Result recognize(const cv::Mat& image,
+                     const RequestContext& ctx = RequestContext()) const
+            REC_THROW(RecException);
+
+    /**
+     * @brief Recognizer public interface with progressive results.
+     * @detailed Same as above, but areas are recognized in reading order
+     * and every area with text is reported as soon as it and all areas
+     * before it are done, so the first lines are shown long before the
+     * whole image is recognized. Callback is called from the calling
+     * thread or from budget threads, one call at a time. Text of result
+     * is joined in reading order.
+     *
+     * @param[in] image OpenCV matrix image representation.
+     * @param[in] on_area Called for every recognized area, may be null.
+     * @param[in] ctx Request deadline and cancel token.
+     * @return Recognition result, may be partial.
+     * @throw RecException if occured critical error.
+     */
+    Result recognize(const cv::Mat& image, const AreaCallback& on_area,
+                     const RequestContext& ctx = RequestContext()) const
+            REC_THROW(RecException);
+
+    /**
+     * @brief Find text areas of image without recognizing them.
+     *
+     * @param[in] image OpenCV matrix image representation.
+     * @param[in] ctx Request deadline and cancel token.
+     * @return Rectangles of text areas, empty if request expired.
+     * @throw RecException if occured critical error.
+     */
+    BoxesGroups detect(const cv::Mat& image,
+                       const RequestContext& ctx = RequestContext()) const
+            REC_THROW(RecException);
+
+    /**
+     * @brief Recognize text of given areas of image.
+     *
+     * @param[in] image OpenCV matrix image representation.
+     * @param[in] boxes Rectangles of text areas inside image.
+     * @param[in] ctx Request deadline and cancel token.
+     * @return Text of every area, empty if nothing has been recognized
+     * or request expired.
+     * @throw RecException if occured critical error.
+     */
+    Text recognize_areas(const cv::Mat& image, const BoxesGroups& boxes,
+                         const RequestContext& ctx = RequestContext()) const
+            REC_THROW(RecException);
+
+    /**
+     * @brief Sort text areas in reading order.
+     * @detailed Areas are grouped into lines by vertical overlap, lines
+     * go top to bottom and areas of a line left to right.
+     *
+     * @param[out] boxes Rectangles of text areas.
+     */
+    static void reading_order(BoxesGroups& boxes);
+
+    /**
+     * @brief Initialize models ahead of first request.
+     * @detailed Recognizes a dummy image and initializes tesseract
+     * instances, so first requests don't pay initialization and state
+     * is ready to be shared by forked workers.
+     *
+     * @param[in] ocr_instances Number of idle tesseract instances to have.
+     * @throw RecException if occured critical error.
+     */
+    void warm_up(std::size_t ocr_instances = 1) const REC_THROW(RecException);
+
+    /**
+     * @brief Configuration of recognizer.
+     */
+    const Config& config() const;
 
     /**
      * @brief Set full paths to algorithm classifiers.
-     * @detailed Set paths to algorithm classifiers. By default searching
-     * path is application path.
+     * @detailed Set paths to algorithm classifiers used by static
+     * interface. By default searching path is application path.
+     * Replaces the instance returned by instance(), recognitions
+     * already running keep using the previous one.
      *     
      * @param[in] classifierNM1 Classifier for stage 1 of Neumann algorithm.
      * @param[in] classifierNM2 Classifier for stage 2 of Neumann algorithm.
      * @param[in] classifierGrouping for grouping.
+     * @throw RecException if classifiers could not be loaded.
      */
     static void set_classifiers(const std::string& classifierNM1,
                                 const std::string& classifierNM2,
-                                const std::string& classifierGrouping);
+                                const std::string& classifierGrouping)
+            REC_THROW(RecException);
+
+    /**
+     * @brief Milliseconds passed since the time point.
+     *
+     * @param[in] start Time point of stage start.
+     * @return Elapsed time in milliseconds.
+     */
+    static double elapsed_ms(const Clock::time_point& start);
 
 private:
 
@@ -114,9 +282,33 @@ private:
      * @detailed Find rectangles containing characters.
      *
      * @param[in] image OpenCV matrix image representation.
-     * @return All founded rectangles containing with characters.
+     * @param[in] ctx Request deadline and cancel token.
+     * @return All founded rectangles containing with characters,
+     * empty if request expired.
      */    
-    static BoxesGroups find_text_rects(const cv::Mat& image);
+    BoxesGroups find_text_rects(const cv::Mat& image,
+                                const RequestContext& ctx) const;
+
+    /**
+     * @brief Create external filters of N&M algorithm stages.
+     * @detailed Filters keep state of a run, classifiers are shared.
+     *
+     * @return Filter with classifier and thresholds of config.
+     * @throw RecException if filter could not be created.
+     */
+    ERFilterPtr create_filter_nm1() const REC_THROW(RecException);
+    ERFilterPtr create_filter_nm2() const REC_THROW(RecException);
+
+    /**
+     * @brief Compute channels for ER filters.
+     * @detailed Compute channels of configured channel set.
+     *
+     * @param[in] image OpenCV matrix image representation.
+     * @param[in] set Channel set.
+     * @return Channels for ER filters.
+     */
+    static Channels compute_channels(const cv::Mat& image,
+                                     Config::Channels set);
 
     /**
      * @brief Removing duplicate rectangles.
@@ -138,15 +330,75 @@ private:
     static TextAreas create_text_areas(const cv::Mat& image,
                                      const BoxesGroups& boxes);
 
+    /**
+     * @brief Whether boxes cover so much of image that it is recognized
+     * as one area.
+     */
+    static bool covers_image(const cv::Mat& image, const BoxesGroups& boxes);
+
+    /**
+     * @brief Create binarized image piece of one text area.
+     *
+     * @param[in] image OpenCV matrix image representation.
+     * @param[in] box Rectangle of text area.
+     * @return Text area.
+     */
+    static cv::Mat create_text_area(const cv::Mat& image,
+                                    const cv::Rect& box);
+
     /**
      * @brief Recognize preprocessed images for characters using tesseract ocr.
      * @detailed Recognize preprocessed images for characters using
      * tesseract ocr.
      *
      * @param[in] areas Preprocessed images.
-     * @return Not empty string with recognized text.
+     * @param[in] ctx Request deadline and cancel token.
+     * @return Not empty string with recognized text, text of areas
+     * processed before expiration if request expired.
      */        
-    static std::string alphabet_analisis(const TextAreas& areas);
+    std::string alphabet_analisis(const TextAreas& areas,
+                                  const RequestContext& ctx) const;
+
+    typedef std::function<void(std::size_t, const std::string&)> TextCallback;
+
+    /**
+     * @brief Recognize every preprocessed image.
+     *
+     * @param[in] areas Preprocessed images.
+     * @param[in] ctx Request deadline and cancel token.
+     * @param[in] done Called with index and text of every area in areas
+     * order as soon as it and areas before it are done, may be null.
+     * @return Text of every area in areas order.
+     */
+    Text recognize_texts(const TextAreas& areas, const RequestContext& ctx,
+                         const TextCallback& done = TextCallback()) const;
+
+    /**
+     * @brief Join not empty texts of areas.
+     */
+    static std::string join(const Text& text);
+
+    /**
+     * @brief Recognize one preprocessed image with tesseract instance.
+     *
+     * @param[in] ocr Leased tesseract instance.
+     * @param[in] area Preprocessed image.
+     * @param[in] ctx Request deadline and cancel token.
+     * @return Recognized text without trash, empty if nothing has been
+     * recognized or request expired.
+     */
+    std::string recognize_area(tesseract::TessBaseAPI& ocr,
+                               const cv::Mat& area,
+                               const RequestContext& ctx) const;
+
+    /**
+     * @brief Tesseract monitor callback for request cancellation.
+     *
+     * @param[in] cancel_this Request context.
+     * @param[in] words Number of recognized words.
+     * @return true if recognition should be stopped.
+     */
+    static bool cancel_ocr(void* cancel_this, int words);
 
     /**
      * @brief Parse the string for the presence of unnecessary characters.
@@ -167,10 +419,17 @@ private:
     static std::string normalize_result(const Text& text);
 
 private:
+    typedef cv::Ptr<cv::text::ERFilter::Callback> ClassifierPtr;
+
     static const uchar max_channel_;
-    static std::string classifierNM1_;
-    static std::string classifierNM2_;
-    static std::string classifierGrouping_;
+    static Ptr instance_;
+
+    const Config config_;
+    ClassifierPtr classifierNM1_;
+    ClassifierPtr classifierNM2_;
+    std::string classifierGrouping_;
+    TessData::Ptr tessdata_;
+    std::unique_ptr<OcrPool> ocr_pool_;
 };
 
 }
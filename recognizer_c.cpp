@@ -0,0 +1,365 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * @file recognizer_c.cpp
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing C interface of recognizer library definition.
+ */
+
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+
+#include "recognizer_c.h"
+#include "engine.h"
+
+/**
+ * Engine with results waiting to be fetched.
+ */
+struct rec_engine {
+    rec_engine()
+            : mutex(), ready(), outstanding(), results(), next_ticket(1),
+              engine()
+    {}
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    // Submitted and not fetched tickets
+    std::set<rec_ticket> outstanding;
+    std::map<rec_ticket, recognizer::Engine::Outcome> results;
+    rec_ticket next_ticket;
+    // Destroyed first, so callbacks never see destroyed members
+    std::unique_ptr<recognizer::Engine> engine;
+};
+
+struct rec_result {
+    recognizer::Engine::Outcome outcome{};
+};
+
+namespace
+{
+
+thread_local std::string last_error;
+
+/**
+ * Remember failure description for rec_last_error().
+ */
+rec_status
+fail(rec_status status, const std::string& message)
+{
+    last_error = message;
+    return status;
+}
+
+/**
+ * Prefix classifier file names of config with directory.
+ */
+void
+locate_classifiers(recognizer::Config& config, const std::string& dir)
+{
+    std::string* paths[] = {
+        &config.classifier_nm1,
+        &config.classifier_nm2,
+        &config.classifier_grouping
+    };
+
+    for (std::string* path : paths) {
+        if (*path != RECOGNIZER_EMBEDDED_MODEL) {
+            *path = dir + "/" + *path;
+        }
+    }
+}
+
+/**
+ * Engine settings from C options.
+ */
+recognizer::Engine::Options
+engine_options(const rec_options& options)
+{
+    recognizer::Engine::Options result;
+    result.workers = options.workers;
+    result.read_ahead = options.queue;
+    result.max_in_flight = options.max_in_flight;
+    result.threads = options.threads;
+
+    if (options.preset) {
+        result.config = recognizer::Config::preset(options.preset);
+    }
+    if (options.tessdata_file) {
+        result.config.tessdata_file = options.tessdata_file;
+        result.degraded_config.tessdata_file = options.tessdata_file;
+    }
+    if (options.classifier_dir) {
+        locate_classifiers(result.config, options.classifier_dir);
+        locate_classifiers(result.degraded_config, options.classifier_dir);
+    }
+
+    return result;
+}
+
+}
+
+int
+rec_api_version(void)
+{
+    return REC_API_VERSION;
+}
+
+const char*
+rec_last_error(void)
+{
+    return last_error.c_str();
+}
+
+void
+rec_options_init(rec_options* options)
+{
+    if (options) {
+        *options = rec_options();
+        options->size = sizeof(rec_options);
+    }
+}
+
+/**
+ * Load models and start worker threads.
+ */
+rec_engine*
+rec_engine_create(const rec_options* options)
+{
+    rec_options defaults;
+    rec_options_init(&defaults);
+
+    // Options of older callers are shorter, the rest keeps defaults
+    if (options) {
+        if (options->size < sizeof(options->size) ||
+            options->size > sizeof(rec_options)) {
+            fail(REC_INVALID, "invalid options size");
+            return nullptr;
+        }
+
+        std::memcpy(&defaults, options, options->size);
+    }
+
+    try {
+        std::unique_ptr<rec_engine> handle(new rec_engine());
+        rec_engine* self = handle.get();
+
+        handle->engine.reset(new recognizer::Engine(engine_options(defaults),
+            [self](const recognizer::Engine::Outcome& outcome) {
+                std::lock_guard<std::mutex> lock(self->mutex);
+                self->results[outcome.id] = outcome;
+                self->ready.notify_all();
+            }));
+
+        return handle.release();
+    } catch (const std::exception& ex) {
+        fail(REC_ERROR, ex.what());
+    } catch (...) {
+        fail(REC_ERROR, "unknown error");
+    }
+
+    return nullptr;
+}
+
+/**
+ * Finish submitted requests and destroy engine.
+ */
+void
+rec_engine_destroy(rec_engine* engine)
+{
+    if (engine) {
+        engine->engine.reset();
+        delete engine;
+    }
+}
+
+/**
+ * Submit encoded image for recognition.
+ */
+rec_status
+rec_engine_submit(rec_engine* engine, const void* data, size_t size,
+                  long timeout_ms, rec_ticket* ticket)
+{
+    if (!engine || !data || !size || !ticket) {
+        return fail(REC_INVALID, "invalid argument");
+    }
+
+    try {
+        {
+            std::lock_guard<std::mutex> lock(engine->mutex);
+            *ticket = engine->next_ticket++;
+            engine->outstanding.insert(*ticket);
+        }
+
+        const uchar* bytes = static_cast<const uchar*>(data);
+
+        recognizer::Engine::Job job(static_cast<std::size_t>(*ticket),
+                                    std::string(),
+                                    recognizer::RequestContext::timeout(
+                                            timeout_ms));
+        job.data.assign(bytes, bytes + size);
+
+        switch (engine->engine->submit(std::move(job))) {
+        case recognizer::Engine::Admission::accepted:
+        case recognizer::Engine::Admission::degraded:
+            return REC_OK;
+        case recognizer::Engine::Admission::shed:
+            return fail(REC_SHED, "estimated wait exceeds limits");
+        case recognizer::Engine::Admission::rejected:
+            return fail(REC_ERROR, "unsupported image type");
+        case recognizer::Engine::Admission::closed:
+            break;
+        }
+    } catch (const std::exception& ex) {
+        std::lock_guard<std::mutex> lock(engine->mutex);
+        engine->outstanding.erase(*ticket);
+        return fail(REC_ERROR, ex.what());
+    }
+
+    std::lock_guard<std::mutex> lock(engine->mutex);
+    engine->outstanding.erase(*ticket);
+
+    return fail(REC_CLOSED, "engine is closed");
+}
+
+/**
+ * Fetch result of submitted request.
+ */
+rec_status
+rec_engine_fetch(rec_engine* engine, rec_ticket ticket, long wait_ms,
+                 rec_result** result)
+{
+    if (!engine || !ticket || !result) {
+        return fail(REC_INVALID, "invalid argument");
+    }
+
+    std::unique_lock<std::mutex> lock(engine->mutex);
+    if (!engine->outstanding.count(ticket)) {
+        return fail(REC_INVALID, "unknown ticket");
+    }
+
+    auto has_result = [engine, ticket] {
+        return engine->results.count(ticket) != 0;
+    };
+
+    if (wait_ms < 0) {
+        engine->ready.wait(lock, has_result);
+    } else if (!engine->ready.wait_for(lock,
+                                       std::chrono::milliseconds(wait_ms),
+                                       has_result)) {
+        return REC_PENDING;
+    }
+
+    try {
+        std::unique_ptr<rec_result> handle(new rec_result());
+        handle->outcome = std::move(engine->results[ticket]);
+        engine->results.erase(ticket);
+        engine->outstanding.erase(ticket);
+        *result = handle.release();
+    } catch (const std::exception& ex) {
+        return fail(REC_ERROR, ex.what());
+    }
+
+    return REC_OK;
+}
+
+/**
+ * Recognize encoded image and wait for result.
+ */
+rec_status
+rec_engine_recognize(rec_engine* engine, const void* data, size_t size,
+                     long timeout_ms, rec_result** result)
+{
+    rec_ticket ticket = 0;
+    rec_status status = rec_engine_submit(engine, data, size,
+                                          timeout_ms, &ticket);
+    if (status != REC_OK && status != REC_SHED) {
+        return status;
+    }
+
+    return rec_engine_fetch(engine, ticket, -1, result);
+}
+
+void
+rec_result_destroy(rec_result* result)
+{
+    delete result;
+}
+
+const char*
+rec_result_text(const rec_result* result)
+{
+    return result ? result->outcome.result.text.c_str() : "";
+}
+
+const char*
+rec_result_error(const rec_result* result)
+{
+    return result ? result->outcome.error.c_str() : "";
+}
+
+int
+rec_result_expired(const rec_result* result)
+{
+    return result && result->outcome.result.expired ? 1 : 0;
+}
+
+size_t
+rec_result_box_count(const rec_result* result)
+{
+    return result ? result->outcome.result.boxes.size() : 0;
+}
+
+rec_status
+rec_result_box(const rec_result* result, size_t index,
+               int* x, int* y, int* width, int* height)
+{
+    if (!result || index >= result->outcome.result.boxes.size()) {
+        return fail(REC_INVALID, "box index out of range");
+    }
+
+    const cv::Rect& box = result->outcome.result.boxes[index];
+    if (x) {
+        *x = box.x;
+    }
+    if (y) {
+        *y = box.y;
+    }
+    if (width) {
+        *width = box.width;
+    }
+    if (height) {
+        *height = box.height;
+    }
+
+    return REC_OK;
+}
+
+double
+rec_result_total_ms(const rec_result* result)
+{
+    return result ? result->outcome.total_ms : 0.0;
+}
@@ -0,0 +1,222 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * @file recognizer_c.h
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing C interface of recognizer library.
+ *
+ * @detailed Engine and result are opaque handles. Engine keeps models
+ * loaded and worker threads running between requests, so one engine is
+ * created per process and shared by all callers. Functions never throw,
+ * failures are reported by status codes and rec_last_error().
+ *
+ * Typical use:
+ *
+ *     rec_options options;
+ *     rec_options_init(&options);
+ *     rec_engine* engine = rec_engine_create(&options);
+ *
+ *     rec_ticket ticket;
+ *     rec_engine_submit(engine, data, size, 1000, &ticket);
+ *
+ *     rec_result* result;
+ *     if (rec_engine_fetch(engine, ticket, -1, &result) == REC_OK) {
+ *         puts(rec_result_text(result));
+ *         rec_result_destroy(result);
+ *     }
+ *
+ *     rec_engine_destroy(engine);
+ */
+
+#ifndef RECOGNIZER_C_H_
+#define RECOGNIZER_C_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Interface version, incremented on incompatible changes only.
+ */
+#define REC_API_VERSION 1
+
+/**
+ * Status codes.
+ */
+typedef enum rec_status {
+    REC_OK = 0,
+    // Invalid argument or unknown ticket
+    REC_INVALID = 1,
+    // Result is not ready yet
+    REC_PENDING = 2,
+    // Engine is shutting down and rejects requests
+    REC_CLOSED = 3,
+    // Request has been shed by admission control
+    REC_SHED = 4,
+    // Other failure, see rec_last_error()
+    REC_ERROR = 5
+} rec_status;
+
+typedef struct rec_engine rec_engine;
+typedef struct rec_result rec_result;
+typedef uint64_t rec_ticket;
+
+/**
+ * Engine settings. Initialize with rec_options_init() before setting
+ * fields, so options of newer library versions get their defaults.
+ */
+typedef struct rec_options {
+    // Size of structure filled in by rec_options_init()
+    size_t size;
+    // Detection and ocr preset: "fast", "balanced" or "accurate",
+    // NULL means "balanced"
+    const char* preset;
+    // Traineddata file mapped once for all workers, may be NULL
+    const char* tessdata_file;
+    // Directory of classifier files, NULL means current directory,
+    // ignored when classifiers are embedded
+    const char* classifier_dir;
+    // Number of recognition threads, 0 means thread budget
+    unsigned int workers;
+    // Number of buffers waiting for workers, 0 means 2 * workers
+    unsigned int queue;
+    // Maximum requests in flight, above it requests are shed,
+    // 0 means submit blocks
+    unsigned int max_in_flight;
+    // Thread budget of engine, 0 means CPUs allowed by affinity and
+    // cgroup quota
+    unsigned int threads;
+} rec_options;
+
+/**
+ * @brief Interface version of loaded library.
+ */
+int rec_api_version(void);
+
+/**
+ * @brief Description of last failure in calling thread.
+ * @return Message valid until next call in the same thread, never NULL.
+ */
+const char* rec_last_error(void);
+
+/**
+ * @brief Fill in default settings.
+ */
+void rec_options_init(rec_options* options);
+
+/**
+ * @brief Load models and start worker threads.
+ *
+ * @param[in] options Engine settings, NULL means defaults.
+ * @return Engine handle, NULL on failure.
+ */
+rec_engine* rec_engine_create(const rec_options* options);
+
+/**
+ * @brief Finish submitted requests and destroy engine.
+ * @detailed Results which have not been fetched are destroyed.
+ */
+void rec_engine_destroy(rec_engine* engine);
+
+/**
+ * @brief Submit encoded image for recognition.
+ * @detailed Buffer is copied, caller may free it after return.
+ *
+ * @param[in] engine Engine handle.
+ * @param[in] data Encoded image in any format OpenCV decodes.
+ * @param[in] size Size of image in bytes.
+ * @param[in] timeout_ms Deadline from now, 0 means no deadline.
+ * @param[out] ticket Ticket to fetch result with.
+ * @return REC_OK, REC_SHED if request has been rejected by admission
+ * control (its result with error is still fetched with the ticket),
+ * REC_CLOSED or REC_INVALID.
+ */
+rec_status rec_engine_submit(rec_engine* engine,
+                             const void* data, size_t size,
+                             long timeout_ms, rec_ticket* ticket);
+
+/**
+ * @brief Fetch result of submitted request.
+ * @detailed Result is handed over to caller and ticket becomes unknown.
+ *
+ * @param[in] engine Engine handle.
+ * @param[in] ticket Ticket from rec_engine_submit().
+ * @param[in] wait_ms Time to wait for result, 0 polls, negative waits
+ * until result is ready.
+ * @param[out] result Result handle, destroy with rec_result_destroy().
+ * @return REC_OK, REC_PENDING if result is not ready or REC_INVALID.
+ */
+rec_status rec_engine_fetch(rec_engine* engine, rec_ticket ticket,
+                            long wait_ms, rec_result** result);
+
+/**
+ * @brief Recognize encoded image and wait for result.
+ */
+rec_status rec_engine_recognize(rec_engine* engine,
+                                const void* data, size_t size,
+                                long timeout_ms, rec_result** result);
+
+/**
+ * @brief Destroy result.
+ */
+void rec_result_destroy(rec_result* result);
+
+/**
+ * @brief Recognized text, UTF-8, empty if nothing has been found.
+ */
+const char* rec_result_text(const rec_result* result);
+
+/**
+ * @brief Error description, empty if recognition succeeded.
+ */
+const char* rec_result_error(const rec_result* result);
+
+/**
+ * @brief Non-zero if deadline passed and result is partial.
+ */
+int rec_result_expired(const rec_result* result);
+
+/**
+ * @brief Number of found text areas.
+ */
+size_t rec_result_box_count(const rec_result* result);
+
+/**
+ * @brief Rectangle of text area in image coordinates.
+ * @return REC_OK or REC_INVALID if index is out of range.
+ */
+rec_status rec_result_box(const rec_result* result, size_t index,
+                          int* x, int* y, int* width, int* height);
+
+/**
+ * @brief Time spent decoding and recognizing image in milliseconds.
+ */
+double rec_result_total_ms(const rec_result* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RECOGNIZER_C_H_
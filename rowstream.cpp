@@ -0,0 +1,228 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * @file rowstream.cpp
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing streaming recognition of row bands definition.
+ */
+
+#include <algorithm>
+#include <utility>
+
+#include "rowstream.h"
+
+namespace recognizer
+{
+
+/**
+ * Create stream of image.
+ */
+RowStream::RowStream(Recognizer::Ptr recognizer, Callback callback,
+                     const Options& options, const RequestContext& ctx)
+        REC_THROW(RecException)
+        : recognizer_(std::move(recognizer)),
+          callback_(std::move(callback)),
+          options_(options),
+          ctx_(ctx),
+          cols_(0),
+          type_(0),
+          window_(),
+          top_(0),
+          pending_(),
+          detected_(0)
+{
+    if (options_.overlap_rows < 0 ||
+        options_.window_rows <= options_.overlap_rows) {
+        throw RecException("row window has no rows outside overlap");
+    }
+}
+
+/**
+ * Append rows to image.
+ */
+void
+RowStream::push(const cv::Mat& band) REC_THROW(RecException)
+{
+    if (band.empty()) {
+        return;
+    }
+
+    if (!rows()) {
+        cols_ = band.cols;
+        type_ = band.type();
+    } else if (band.cols != cols_ || band.type() != type_) {
+        throw RecException("row band doesn't match previous ones");
+    }
+
+    // Window is filled up and processed as many times as band needs
+    int row = 0;
+    while (row < band.rows) {
+        int count = std::min(band.rows - row,
+                             options_.window_rows - window_.rows);
+        window_.push_back(band.rowRange(row, row + count));
+        row += count;
+
+        if (window_.rows >= options_.window_rows) {
+            process(false);
+        }
+    }
+}
+
+/**
+ * Report the rest of lines after the last band.
+ */
+void
+RowStream::finish() REC_THROW(RecException)
+{
+    if (!window_.empty()) {
+        process(true);
+    }
+}
+
+/**
+ * Number of rows pushed.
+ */
+int
+RowStream::rows() const
+{
+    return top_ + window_.rows;
+}
+
+/**
+ * Find row above which no area crosses.
+ */
+int
+RowStream::cut_rows(const Recognizer::BoxesGroups& boxes, int limit)
+{
+    int cut = limit;
+    bool lowered = true;
+    while (lowered) {
+        lowered = false;
+        for (const cv::Rect& box : boxes) {
+            if (box.y < cut && box.br().y > cut) {
+                cut = box.y;
+                lowered = true;
+            }
+        }
+    }
+
+    return cut;
+}
+
+/**
+ * Recognize complete lines of window and drop rows above them.
+ */
+void
+RowStream::process(bool last)
+{
+    // Rows detected before are detected again only in the band above
+    // the new ones, which gives areas crossing into them full context
+    int from = std::max(detected_ - options_.overlap_rows, 0);
+    Recognizer::BoxesGroups detected = recognizer_->detect(
+            window_.rowRange(from, window_.rows), ctx_);
+    for (cv::Rect& box : detected) {
+        box.y += from;
+    }
+
+    // Areas detected again inside band are already pending, pending ones
+    // overlapped by areas crossing into new rows are replaced by them
+    Recognizer::BoxesGroups boxes;
+    for (const cv::Rect& box : pending_) {
+        bool replaced = false;
+        for (const cv::Rect& fresh : detected) {
+            replaced = replaced || (fresh.br().y > detected_ &&
+                                    (fresh & box).area() > 0);
+        }
+        if (!replaced) {
+            boxes.push_back(box);
+        }
+    }
+    for (const cv::Rect& box : detected) {
+        if (box.br().y > detected_) {
+            boxes.push_back(box);
+        }
+    }
+
+    // Rows above cut are dropped, lines crossing it wait for more rows
+    int limit = window_.rows - options_.overlap_rows;
+    int cut = cut_rows(boxes, last ? window_.rows : limit);
+
+    // Line taller than window without overlap is taken as it is
+    bool forced = cut <= 0;
+    if (forced) {
+        cut = window_.rows - options_.overlap_rows;
+    }
+
+    Recognizer::BoxesGroups complete;
+    for (const cv::Rect& box : boxes) {
+        if (box.br().y <= cut || (forced && box.y < cut)) {
+            complete.push_back(box);
+        }
+    }
+
+    Recognizer::reading_order(complete);
+
+    Recognizer::Text texts = recognizer_->recognize_areas(window_, complete,
+                                                          ctx_);
+    for (std::size_t l = 0; l < complete.size(); ++l) {
+        if (texts[l].empty()) {
+            continue;
+        }
+
+        Line line;
+        line.text = std::move(texts[l]);
+        line.box = complete[l] + cv::Point(0, top_);
+        line.truncated = complete[l].br().y > cut;
+        callback_(line);
+    }
+
+    // Areas below cut ending above the overlap and every area crossing
+    // into it are complete, the rest is detected again with next rows
+    Recognizer::BoxesGroups kept;
+    for (const cv::Rect& box : boxes) {
+        if (box.y >= cut) {
+            kept.push_back(box);
+        }
+    }
+    // Rest of a cut line is detected again from the cut
+    int detected_row = forced ? cut : std::max(cut_rows(kept, limit), cut);
+
+    pending_.clear();
+    for (const cv::Rect& box : kept) {
+        if (box.br().y <= detected_row) {
+            pending_.push_back(box + cv::Point(0, -cut));
+        }
+    }
+
+    // Only rows below cut are kept, copied to release the rest
+    if (cut >= window_.rows) {
+        window_ = cv::Mat();
+        pending_.clear();
+        detected_ = 0;
+    } else {
+        window_ = window_.rowRange(cut, window_.rows).clone();
+        detected_ = detected_row - cut;
+    }
+    top_ += cut;
+}
+
+}
@@ -0,0 +1,164 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * @file rowstream.h
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing streaming recognition of row bands declaration.
+ */
+
+#ifndef ROWSTREAM_H_
+#define ROWSTREAM_H_
+
+#include <cstddef>
+#include <functional>
+#include <string>
+
+#include "recognizer.h"
+
+namespace recognizer
+{
+
+/**
+ * @brief Class RowStream recognizes image which arrives as a sequence of
+ * row bands, like output of a continuous scanner.
+ *
+ * @detailed Rows are collected into a window of bounded height. When it
+ * is full, text is detected in the rows added since the last window and
+ * an overlap band above them, areas detected before above the band are
+ * kept. Areas which end above the overlap at the bottom of the window
+ * are complete: they are recognized and reported at once, and the rows
+ * above them are dropped. Areas reaching into the overlap are left for
+ * the next window, which starts at them. Memory and detection work per
+ * row stay bounded by the window whatever the height of the image. Text
+ * taller than the window without overlap is cut and its line is marked
+ * truncated.
+ */
+
+class RowStream {
+public:
+
+    /**
+     * @brief Recognized text line with box in image coordinates.
+     */
+    struct Line {
+        std::string text{};
+        cv::Rect box{};
+        // Line has been cut by window, its rows below box are detected
+        // with the next window as a separate line
+        bool truncated = false;
+    };
+
+    typedef std::function<void(const Line&)> Callback;
+
+    /**
+     * @brief Stream settings.
+     */
+    struct Options {
+        Options()
+                : window_rows(2048), overlap_rows(256)
+        {}
+
+        // Maximum number of rows kept
+        int window_rows;
+        // Rows at the bottom of window where text may be incomplete
+        int overlap_rows;
+    };
+
+    /**
+     * @brief Create stream of image.
+     *
+     * @param[in] recognizer Recognizer of image.
+     * @param[in] callback Called for every line in reading order.
+     * @param[in] options Window settings.
+     * @param[in] ctx Request deadline and cancel token.
+     * @throw RecException if window has no rows outside overlap.
+     */
+    RowStream(Recognizer::Ptr recognizer, Callback callback,
+              const Options& options = Options(),
+              const RequestContext& ctx = RequestContext())
+            REC_THROW(RecException);
+
+    RowStream(const RowStream&) = delete;
+    RowStream& operator=(const RowStream&) = delete;
+
+    /**
+     * @brief Append rows to image.
+     * @detailed Lines completed by the rows are reported before push
+     * returns. Band is copied, it may be reused by caller.
+     *
+     * @param[in] band Rows of the same width and type as previous ones.
+     * @throw RecException if band doesn't match previous ones or
+     * recognition failed.
+     */
+    void push(const cv::Mat& band) REC_THROW(RecException);
+
+    /**
+     * @brief Report the rest of lines after the last band.
+     * @throw RecException if recognition failed.
+     */
+    void finish() REC_THROW(RecException);
+
+    /**
+     * @brief Number of rows pushed.
+     */
+    int rows() const;
+
+    /**
+     * @brief Find row above which no area crosses.
+     * @detailed Cut is lowered to the top of every area crossing it until
+     * none does, as lowering it may make another area cross it. Areas
+     * below the cut are not lost, they stay in the window for the next
+     * rows.
+     *
+     * @param[in] boxes Rectangles of text areas.
+     * @param[in] limit Lowest row of cut.
+     * @return Cut row, 0 or less if areas overlap down from the top.
+     */
+    static int cut_rows(const Recognizer::BoxesGroups& boxes, int limit);
+
+private:
+    /**
+     * @brief Recognize complete lines of window and drop rows above them.
+     *
+     * @param[in] last No more rows follow, all lines are complete.
+     */
+    void process(bool last);
+
+    Recognizer::Ptr recognizer_;
+    Callback callback_;
+    const Options options_;
+    const RequestContext ctx_;
+    // Geometry of first band
+    int cols_;
+    int type_;
+    // Kept rows and image row of its first row
+    cv::Mat window_;
+    int top_;
+    // Areas of kept rows already detected in full and window row down to
+    // which no area is left for the next detection
+    Recognizer::BoxesGroups pending_;
+    int detected_;
+};
+
+}
+
+#endif // ROWSTREAM_H_
@@ -0,0 +1,100 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * @file tessdata.cpp
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing memory mapped tesseract traineddata.
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "tessdata.h"
+
+namespace recognizer
+{
+
+/**
+ * Map traineddata file or get existing mapping.
+ */
+TessData::Ptr
+TessData::load(const std::string& file) REC_THROW(RecException)
+{
+    static std::mutex mutex;
+    static std::map<std::string, std::weak_ptr<const TessData>> mappings;
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    Ptr mapping = mappings[file].lock();
+    if (mapping) {
+        return mapping;
+    }
+
+    int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw RecException("could not open " + file + ": " +
+                           std::strerror(errno));
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) || st.st_size <= 0) {
+        ::close(fd);
+        throw RecException("bad traineddata file " + file);
+    }
+
+    std::size_t size = static_cast<std::size_t>(st.st_size);
+    void* data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    int err = errno;
+    ::close(fd);
+
+    if (data == MAP_FAILED) {
+        throw RecException("could not map " + file + ": " +
+                           std::strerror(err));
+    }
+
+    // Tesseract reads the whole buffer on every init
+    ::madvise(data, size, MADV_WILLNEED);
+
+    mapping.reset(new TessData(file, data, size));
+    mappings[file] = mapping;
+
+    return mapping;
+}
+
+TessData::TessData(const std::string& file, void* data, std::size_t size)
+        : file_(file),
+          data_(data),
+          size_(size)
+{}
+
+TessData::~TessData()
+{
+    ::munmap(data_, size_);
+}
+
+}
@@ -0,0 +1,96 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * @file tessdata.h
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing memory mapped tesseract traineddata.
+ */
+
+#ifndef TESSDATA_H_
+#define TESSDATA_H_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "recexcept.h"
+
+namespace recognizer
+{
+
+/**
+ * @brief Read-only memory mapping of tesseract traineddata file.
+ *
+ * @detailed Tesseract init takes the mapping instead of looking up and
+ * reading the file, so the file is opened and read from disk once.
+ * Tesseract still copies every traineddata entry into its own buffers
+ * on each init, so the mapping doesn't save memory of initialized
+ * instances. Those are shared only by PreforkServer workers, which
+ * inherit instances initialized by the parent copy-on-write.
+ * Mappings are cached by path, recognizers with the same traineddata
+ * share one mapping.
+ */
+
+class TessData {
+public:
+    typedef std::shared_ptr<const TessData> Ptr;
+
+    /**
+     * @brief Map traineddata file or get existing mapping.
+     *
+     * @param[in] file Path of traineddata file.
+     * @return Shared mapping.
+     * @throw RecException if file could not be mapped.
+     */
+    static Ptr load(const std::string& file) REC_THROW(RecException);
+
+    TessData(const TessData&) = delete;
+    TessData& operator=(const TessData&) = delete;
+
+    ~TessData();
+
+    const char* data() const
+    {
+        return static_cast<const char*>(data_);
+    }
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+    const std::string& file() const
+    {
+        return file_;
+    }
+
+private:
+    TessData(const std::string& file, void* data, std::size_t size);
+
+private:
+    const std::string file_;
+    void* data_;
+    const std::size_t size_;
+};
+
+}
+
+#endif // TESSDATA_H_
@@ -24,25 +24,127 @@ THE SOFTWARE.
  * @brief File containing test code for recognizer.
  */
 
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
+#include <fstream>
 #include <vector>
 #include <string>
+#include <mutex>
+#include <condition_variable>
+
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "recognizer.h"
 #include "recexcept.h"
+#include "engine.h"
+#include "batch.h"
+#include "prefork.h"
+#include "framering.h"
+#include "rowstream.h"
 
 #define SUPPRESS_UNUSED(arg) (void)(arg)
 
-int main(int argc, char* argv[])
+namespace
 {
-    if (argc != 2) {
-        std::cerr << "Usage: "  << argv[0] << " image" << std::endl;
-        return EXIT_FAILURE;
-    }
 
+void usage(const char* name)
+{
+    std::cerr << "Usage: " << name << " image" << std::endl
+              << "       " << name << " [options] input..." << std::endl
+              << std::endl
+              << "Input is an image file, a directory, a glob pattern or"
+              << std::endl
+              << "a manifest file with one path per line as @file"
+              << " (@- for stdin)." << std::endl
+              << std::endl
+              << "Options:" << std::endl
+              << "  --threads N         thread budget of engine"
+              << " (default: CPUs allowed by affinity and cgroup)"
+              << std::endl
+              << "  -j, --jobs N        recognition threads"
+              << " (default: thread budget)" << std::endl
+              << "  -r, --read-ahead N  files loaded ahead of workers"
+              << " (default: 2 * jobs)" << std::endl
+              << "  --io-depth N        reads in flight per reader"
+              << " (default: read ahead)" << std::endl
+              << "  --io-backend NAME   auto, io_uring or pread"
+              << " (default: auto)" << std::endl
+              << "  --no-map            read and decode uncompressed"
+              << " rasters instead of mapping them" << std::endl
+              << "  --decoders N        decoding threads"
+              << " (default: jobs / 4)" << std::endl
+              << "  --decode-ahead N    images decoded ahead of workers"
+              << " (default: jobs)" << std::endl
+              << "  -m, --manifest FILE read inputs from manifest"
+              << std::endl
+              << "  -o, --output FILE   write JSON lines to file"
+              << " (default: stdout)" << std::endl
+              << "  -t, --timeout MS    per image deadline from submission"
+              << " (default: none)" << std::endl
+              << "  --max-in-flight N   shed images above N in flight"
+              << " (default: block)" << std::endl
+              << "  --queue-target MS   shed or degrade images above"
+              << " estimated queue delay" << std::endl
+              << "  --degrade           degrade instead of shedding"
+              << " when possible" << std::endl
+              << "  --background        submit images as background work"
+              << std::endl
+              << "  --background-share F share of workers for background"
+              << " work (default: 0.2)" << std::endl
+              << "  -p, --preset NAME   fast, balanced or accurate"
+              << " (default: balanced)" << std::endl
+              << "  --degrade-preset NAME preset of degraded images"
+              << " (default: fast)" << std::endl
+              << "  --bench-presets     run inputs under every preset"
+              << " and print throughput table" << std::endl
+              << "  --sort[=N]          submit largest images first,"
+              << " within every N images if given" << std::endl
+              << "  --no-numa           don't pin threads per NUMA node"
+              << std::endl
+              << "  --scheduling NAME   auto, throughput or latency"
+              << " (default: auto)" << std::endl
+              << "  --bench-scheduling  run inputs under every scheduling"
+              << " policy with growing load" << std::endl
+              << "  --watch-models      reload classifiers when their"
+              << " files change" << std::endl
+              << "  --tessdata FILE     map traineddata file once instead"
+              << " of reading it on every init" << std::endl
+              << "  --prefork N         recognize in N worker processes"
+              << " forked after warm up" << std::endl
+              << "  --no-coalesce       recognize identical images in"
+              << " flight separately" << std::endl
+              << "  --frames NAME       recognize frames of shared memory"
+              << " ring NAME until producers close it" << std::endl
+              << "  --frame-slots N     slots of frame ring (default: 8)"
+              << std::endl
+              << "  --frame-mb N        maximum frame size in MiB"
+              << " (default: 32)" << std::endl
+              << "  --frame-replace     replace existing frame ring of"
+              << " the same name" << std::endl
+              << "  --publish NAME      decode inputs and publish them"
+              << " to frame ring NAME" << std::endl
+              << "  --progressive       write every text area as soon as"
+              << " it is recognized" << std::endl
+              << "  --stream-rows N     feed inputs in bands of N rows"
+              << " and print lines as they complete" << std::endl
+              << "  --stream-window N   rows kept by streaming"
+              << " (default: 2048)" << std::endl
+              << "  --soak SECONDS      recognize inputs in rounds and"
+              << " check RSS and latency stay flat" << std::endl
+              << "  --soak-tolerance PERCENT allowed RSS and latency"
+              << " growth (default: 10)" << std::endl;
+}
+
+/**
+ * Recognize single image and print free text.
+ */
+int single_image(const char* file)
+{
     try {
-        std::string text = recognizer::Recognizer::get_text(argv[1]);
+        std::string text = recognizer::Recognizer::get_text(file);
 
         if (!text.empty()) {
             std::cout << "Found text:" << std::endl;
@@ -56,3 +158,928 @@ int main(int argc, char* argv[])
 
     return EXIT_SUCCESS;
 }
+
+bool is_regular_file(const char* file)
+{
+    struct stat st;
+    return !::stat(file, &st) && S_ISREG(st.st_mode);
+}
+
+/**
+ * Batch run settings.
+ */
+struct Settings {
+    recognizer::Engine::Options options{};
+    std::size_t prefork = 0;
+    // Submit largest images first within windows, 0 means whole batch
+    bool sort = false;
+    std::size_t sort_window = 0;
+    long timeout = 0;
+    recognizer::Priority priority = recognizer::Priority::interactive;
+    // Write a JSON line for every area as soon as it is recognized
+    bool progressive = false;
+};
+
+/**
+ * Batch run summary.
+ */
+struct Summary {
+    std::size_t images = 0;
+    std::size_t failed = 0;
+    std::size_t expired = 0;
+    std::size_t text_chars = 0;
+    double seconds = 0.0;
+    std::string io_backend{};
+    recognizer::Engine::Counters counters{};
+    recognizer::LatencyStats total{};
+    recognizer::LatencyStats decode{};
+    recognizer::LatencyStats detect{};
+    recognizer::LatencyStats ocr{};
+};
+
+/**
+ * Submission order of batch, input order unless sorting is enabled.
+ */
+recognizer::Batch::Plan plan_batch(const recognizer::Batch::Files& files,
+                                   const Settings& settings,
+                                   std::size_t workers)
+{
+    if (settings.sort) {
+        return recognizer::Batch::plan(files, workers, settings.sort_window);
+    }
+
+    recognizer::Batch::Plan plan(files.size());
+    for (std::size_t idx = 0; idx < files.size(); ++idx) {
+        plan[idx].index = idx;
+    }
+
+    return plan;
+}
+
+/**
+ * Engine job of planned file, id is the index of input file.
+ */
+recognizer::Engine::Job job(const recognizer::Batch::Files& files,
+                            const recognizer::Batch::Planned& planned,
+                            const Settings& settings)
+{
+    recognizer::RequestContext ctx =
+            recognizer::RequestContext::timeout(settings.timeout);
+    ctx.set_split(planned.split);
+
+    return recognizer::Engine::Job(planned.index, files[planned.index], ctx,
+                                   settings.priority);
+}
+
+/**
+ * Callback adding outcomes to summary, writing JSON lines to out if it
+ * is not null.
+ */
+recognizer::Engine::Callback report(std::ostream* out, std::mutex& out_mutex,
+                                    Summary& summary)
+{
+    return [out, &out_mutex, &summary](
+            const recognizer::Engine::Outcome& outcome) {
+            std::string line = out ?
+                    recognizer::Batch::to_json(outcome) : std::string();
+
+            std::lock_guard<std::mutex> lock(out_mutex);
+            if (out) {
+                *out << line << '\n';
+            }
+
+            if (outcome.result.expired) {
+                ++summary.expired;
+            }
+
+            if (!outcome.error.empty()) {
+                ++summary.failed;
+                return;
+            }
+
+            summary.text_chars += outcome.result.text.length();
+            summary.total.add(outcome.total_ms);
+            summary.decode.add(outcome.decode_ms);
+            summary.detect.add(outcome.result.detect_ms);
+            summary.ocr.add(outcome.result.ocr_ms);
+        };
+}
+
+/**
+ * Run engine over files, write JSON lines to out if it is not null.
+ */
+void run_batch(const recognizer::Batch::Files& files,
+               const Settings& settings,
+               std::ostream* out,
+               Summary& summary)
+{
+    std::mutex out_mutex;
+
+    recognizer::Recognizer::Clock::time_point start =
+            recognizer::Recognizer::Clock::now();
+
+    recognizer::Engine::Callback callback = report(out, out_mutex, summary);
+
+    if (settings.prefork) {
+        recognizer::PreforkServer::Options options;
+        options.workers = settings.prefork;
+        options.queue = settings.options.read_ahead;
+        options.config = settings.options.config;
+
+        recognizer::PreforkServer server(options, callback);
+        for (const recognizer::Batch::Planned& planned :
+                 plan_batch(files, settings, settings.prefork)) {
+            server.submit(job(files, planned, settings));
+        }
+
+        server.finish();
+
+        recognizer::PreforkServer::Memory memory = server.memory();
+        std::cerr << "Workers: " << server.workers() << " processes, RSS "
+                  << memory.rss_mb << " MB, PSS " << memory.pss_mb
+                  << " MB" << std::endl;
+    } else {
+        recognizer::Engine engine(settings.options, callback);
+        for (const recognizer::Batch::Planned& planned :
+                 plan_batch(files, settings, engine.workers())) {
+            recognizer::Engine::Job next = job(files, planned, settings);
+
+            if (settings.progressive && out) {
+                std::size_t id = next.id;
+                next.on_area = [out, &out_mutex, id](
+                        const recognizer::Recognizer::Area& area) {
+                        const cv::Rect& r = area.box;
+                        std::lock_guard<std::mutex> lock(out_mutex);
+                        *out << "{\"id\":" << id
+                             << ",\"area\":" << area.index
+                             << ",\"box\":[" << r.x << ',' << r.y << ','
+                             << r.width << ',' << r.height << ']'
+                             << ",\"text\":\""
+                             << recognizer::Batch::json_escape(area.text)
+                             << "\"}" << std::endl;
+                    };
+            }
+
+            engine.submit(std::move(next));
+        }
+
+        engine.finish();
+        summary.counters = engine.counters();
+        summary.io_backend = engine.io_backend();
+    }
+
+    if (out) {
+        out->flush();
+    }
+
+    summary.images = files.size();
+    summary.seconds = recognizer::Recognizer::elapsed_ms(start) / 1000.0;
+}
+
+double throughput(const Summary& summary)
+{
+    return summary.seconds > 0.0 ? summary.images / summary.seconds : 0.0;
+}
+
+void print_summary(const Summary& summary)
+{
+    std::cerr << std::fixed << std::setprecision(2)
+              << "Processed " << summary.images << " images ("
+              << summary.failed << " failed, "
+              << summary.expired << " expired) in "
+              << summary.seconds << " s, "
+              << throughput(summary) << " images/s" << std::endl;
+
+    std::cerr << "Admission: " << summary.counters.accepted << " accepted, "
+              << summary.counters.degraded << " degraded, "
+              << summary.counters.shed << " shed, "
+              << summary.counters.coalesced << " coalesced" << std::endl;
+
+    if (!summary.io_backend.empty()) {
+        std::cerr << "Reads: " << summary.io_backend << std::endl;
+    }
+
+    if (summary.counters.reloads || summary.counters.reload_failures) {
+        std::cerr << "Models: " << summary.counters.reloads << " reloads, "
+                  << summary.counters.reload_failures << " failed"
+                  << std::endl;
+    }
+
+    if (summary.counters.callback_failures) {
+        std::cerr << "Callbacks: " << summary.counters.callback_failures
+                  << " failed" << std::endl;
+    }
+
+    summary.total.report(std::cerr, "latency");
+    summary.decode.report(std::cerr, "decode");
+    summary.detect.report(std::cerr, "detect");
+    summary.ocr.report(std::cerr, "ocr");
+}
+
+/**
+ * Run files under every preset and print one row per preset.
+ */
+int bench_presets(const recognizer::Batch::Files& files, Settings settings)
+{
+    std::cout << std::left << std::setw(10) << "preset"
+              << std::right << std::setw(12) << "images/s"
+              << std::setw(10) << "p50 ms" << std::setw(10) << "p90 ms"
+              << std::setw(10) << "p99 ms" << std::setw(10) << "failed"
+              << std::setw(12) << "text chars" << std::endl;
+
+    for (const std::string& name : recognizer::Config::presets()) {
+        std::string tessdata = settings.options.config.tessdata_file;
+        settings.options.config = recognizer::Config::preset(name);
+        settings.options.config.tessdata_file = tessdata;
+
+        Summary summary;
+        run_batch(files, settings, nullptr, summary);
+
+        std::cout << std::fixed << std::setprecision(2)
+                  << std::left << std::setw(10) << name
+                  << std::right << std::setw(12) << throughput(summary)
+                  << std::setw(10) << summary.total.percentile(50.0)
+                  << std::setw(10) << summary.total.percentile(90.0)
+                  << std::setw(10) << summary.total.percentile(99.0)
+                  << std::setw(10) << summary.failed
+                  << std::setw(12) << summary.text_chars << std::endl;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Read backend by name.
+ */
+bool parse_backend(const std::string& name,
+                   recognizer::Loader::Backend& backend)
+{
+    if (name == "auto") {
+        backend = recognizer::Loader::Backend::automatic;
+    } else if (name == "io_uring") {
+        backend = recognizer::Loader::Backend::uring;
+    } else if (name == "pread") {
+        backend = recognizer::Loader::Backend::pread;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Scheduling policy by name.
+ */
+bool parse_policy(const std::string& name,
+                  recognizer::ThreadBudget::Policy& policy)
+{
+    if (name == "auto") {
+        policy = recognizer::ThreadBudget::Policy::automatic;
+    } else if (name == "throughput") {
+        policy = recognizer::ThreadBudget::Policy::throughput;
+    } else if (name == "latency") {
+        policy = recognizer::ThreadBudget::Policy::latency;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Run files through engine keeping the given number of images in
+ * flight, like that many clients waiting for their answers.
+ */
+void run_closed_loop(const recognizer::Batch::Files& files,
+                     const Settings& settings, std::size_t clients,
+                     recognizer::LatencyStats& latency, double& seconds)
+{
+    std::mutex mutex;
+    std::condition_variable done;
+    std::size_t in_flight = 0;
+
+    // Every load level sees the same number of images
+    std::size_t images = std::max(files.size(), 4 * clients);
+
+    // Client waits from submission, queueing included
+    std::vector<recognizer::Recognizer::Clock::time_point> submitted(images);
+
+    recognizer::Engine engine(settings.options,
+        [&](const recognizer::Engine::Outcome& outcome) {
+            std::lock_guard<std::mutex> lock(mutex);
+            latency.add(recognizer::Recognizer::elapsed_ms(
+                                submitted[outcome.id]));
+            --in_flight;
+            done.notify_all();
+        });
+
+    recognizer::Recognizer::Clock::time_point start =
+            recognizer::Recognizer::Clock::now();
+
+    for (std::size_t id = 0; id < images; ++id) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            done.wait(lock, [&] { return in_flight < clients; });
+            ++in_flight;
+            submitted[id] = recognizer::Recognizer::Clock::now();
+        }
+
+        engine.submit(recognizer::Engine::Job(
+            id, files[id % files.size()],
+            recognizer::RequestContext::timeout(settings.timeout),
+            settings.priority));
+    }
+
+    engine.finish();
+    seconds = recognizer::Recognizer::elapsed_ms(start) / 1000.0;
+}
+
+/**
+ * Run inputs under every scheduling policy with growing number of
+ * images in flight and print table showing where policies cross over.
+ */
+int bench_scheduling(const recognizer::Batch::Files& files,
+                     Settings settings)
+{
+    if (files.empty()) {
+        std::cerr << "No input images" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Coalescing would hide load of repeated images
+    settings.options.coalesce = false;
+
+    std::size_t threads = settings.options.threads ?
+            settings.options.threads : recognizer::ThreadBudget::available();
+
+    std::cout << std::right << std::setw(10) << "in flight"
+              << std::setw(12) << "policy" << std::setw(12) << "images/s"
+              << std::setw(10) << "p50 ms" << std::setw(10) << "p90 ms"
+              << std::endl;
+
+    const char* policies[] = { "throughput", "latency", "auto" };
+
+    for (std::size_t clients = 1; ; clients *= 2) {
+        for (const char* name : policies) {
+            parse_policy(name, settings.options.scheduling);
+
+            recognizer::LatencyStats latency;
+            double seconds = 0.0;
+            run_closed_loop(files, settings, clients, latency, seconds);
+
+            std::cout << std::fixed << std::setprecision(2)
+                      << std::setw(10) << clients << std::setw(12) << name
+                      << std::setw(12)
+                      << (seconds > 0.0 ? latency.count() / seconds : 0.0)
+                      << std::setw(10) << latency.percentile(50.0)
+                      << std::setw(10) << latency.percentile(90.0)
+                      << std::endl;
+        }
+
+        if (clients >= 2 * threads) {
+            break;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Resident set size of the process in megabytes.
+ */
+double resident_mb()
+{
+    std::ifstream statm("/proc/self/statm");
+
+    std::size_t size = 0, resident = 0;
+    statm >> size >> resident;
+
+    return static_cast<double>(resident) *
+            static_cast<double>(::sysconf(_SC_PAGESIZE)) / (1024.0 * 1024.0);
+}
+
+/**
+ * Mean of values in range [begin, end).
+ */
+double mean(const std::vector<double>& values,
+            std::size_t begin, std::size_t end)
+{
+    double sum = 0.0;
+    for (std::size_t idx = begin; idx < end; ++idx) {
+        sum += values[idx];
+    }
+
+    return end > begin ? sum / (end - begin) : 0.0;
+}
+
+/**
+ * Recognize files in rounds on one engine for the given time and check
+ * that resident memory and latency don't grow.
+ */
+int soak(const recognizer::Batch::Files& files, const Settings& settings,
+         double seconds, double tolerance)
+{
+    if (files.empty()) {
+        std::cerr << "No input images" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::mutex mutex;
+    std::condition_variable done;
+    std::size_t completed = 0;
+    std::size_t failed = 0;
+    recognizer::LatencyStats round;
+
+    recognizer::Engine engine(settings.options,
+        [&](const recognizer::Engine::Outcome& outcome) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (outcome.error.empty()) {
+                round.add(outcome.total_ms);
+            } else {
+                ++failed;
+            }
+
+            ++completed;
+            done.notify_all();
+        });
+
+    std::cout << std::right << std::setw(8) << "round"
+              << std::setw(10) << "seconds" << std::setw(10) << "rss MB"
+              << std::setw(10) << "p50 ms" << std::setw(10) << "p99 ms"
+              << std::endl;
+
+    // First round initializes models and pools and is not measured
+    std::vector<double> rss, p50;
+    recognizer::Recognizer::Clock::time_point start =
+            recognizer::Recognizer::Clock::now();
+    std::size_t submitted = 0;
+
+    for (std::size_t number = 0; ; ++number) {
+        for (std::size_t id = 0; id < files.size(); ++id) {
+            engine.submit(recognizer::Engine::Job(
+                submitted + id, files[id],
+                recognizer::RequestContext::timeout(settings.timeout),
+                settings.priority));
+        }
+        submitted += files.size();
+
+        recognizer::LatencyStats stats;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            done.wait(lock, [&] { return completed == submitted; });
+            std::swap(stats, round);
+        }
+
+        double elapsed = recognizer::Recognizer::elapsed_ms(start) / 1000.0;
+
+        std::cout << std::fixed << std::setprecision(2)
+                  << std::setw(8) << number << std::setw(10) << elapsed
+                  << std::setw(10) << resident_mb()
+                  << std::setw(10) << stats.percentile(50.0)
+                  << std::setw(10) << stats.percentile(99.0) << std::endl;
+
+        if (number) {
+            rss.push_back(resident_mb());
+            p50.push_back(stats.percentile(50.0));
+        }
+
+        if (elapsed >= seconds && rss.size() >= 2) {
+            break;
+        }
+    }
+
+    engine.finish();
+
+    // Compare first and last quarters of measured rounds
+    std::size_t window = std::max<std::size_t>(rss.size() / 4, 1);
+    double rss_first = mean(rss, 0, window);
+    double rss_last = mean(rss, rss.size() - window, rss.size());
+    double p50_first = mean(p50, 0, window);
+    double p50_last = mean(p50, p50.size() - window, p50.size());
+
+    double rss_growth = rss_first > 0.0 ?
+            100.0 * (rss_last - rss_first) / rss_first : 0.0;
+    double p50_growth = p50_first > 0.0 ?
+            100.0 * (p50_last - p50_first) / p50_first : 0.0;
+
+    bool flat = rss_growth <= tolerance && p50_growth <= tolerance;
+
+    std::cout << "RSS: " << rss_first << " -> " << rss_last << " MB ("
+              << rss_growth << "%), p50: " << p50_first << " -> "
+              << p50_last << " ms (" << p50_growth << "%), failed: "
+              << failed << std::endl;
+
+    if (flat) {
+        std::cout << "Soak passed" << std::endl;
+    } else {
+        std::cout << "Soak failed: growth exceeds " << tolerance << "%"
+                  << std::endl;
+    }
+
+    return flat ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Recognize frames of shared memory ring until producers close it.
+ */
+int consume_frames(const std::string& name, std::size_t slots,
+                   std::size_t frame_mb, bool replace,
+                   const Settings& settings, std::ostream* out)
+{
+    std::unique_ptr<recognizer::FrameRing> ring =
+            recognizer::FrameRing::create(name, slots, frame_mb << 20,
+                                          replace);
+
+    std::mutex out_mutex;
+    Summary summary;
+
+    recognizer::Recognizer::Clock::time_point start =
+            recognizer::Recognizer::Clock::now();
+
+    {
+        recognizer::Engine engine(settings.options,
+                                  report(out, out_mutex, summary));
+        std::cerr << "Waiting for frames on " << name << std::endl;
+
+        summary.images = engine.consume(*ring, settings.timeout,
+                                        settings.priority);
+        engine.finish();
+        summary.counters = engine.counters();
+    }
+
+    if (out) {
+        out->flush();
+    }
+
+    summary.seconds = recognizer::Recognizer::elapsed_ms(start) / 1000.0;
+    print_summary(summary);
+
+    return summary.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ * Decode files and publish them to frame ring, id is the index of file.
+ */
+int publish_frames(const std::string& name,
+                   const recognizer::Batch::Files& files)
+{
+    std::unique_ptr<recognizer::FrameRing> ring =
+            recognizer::FrameRing::open(name);
+
+    std::size_t published = 0;
+    for (std::size_t idx = 0; idx < files.size(); ++idx) {
+        cv::Mat image = cv::imread(files[idx], cv::IMREAD_COLOR);
+        if (image.empty()) {
+            std::cerr << "Could not decode " << files[idx] << std::endl;
+            continue;
+        }
+
+        // Decode straight into the slot would need a decoder writing
+        // into given memory, frame is copied once instead
+        std::int64_t now_us =
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch())
+                        .count();
+        if (ring->write(image, idx, now_us)) {
+            ++published;
+        }
+    }
+
+    ring->close();
+    std::cerr << "Published " << published << " frames" << std::endl;
+
+    return published == files.size() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Recognize files fed in row bands, write a JSON line per text line.
+ */
+int stream_files(const recognizer::Batch::Files& files,
+                 const Settings& settings, int band_rows, int window_rows,
+                 std::ostream& out)
+{
+    recognizer::Recognizer::Ptr recognizer =
+            recognizer::Recognizer::create(settings.options.config);
+
+    recognizer::RowStream::Options options;
+    options.window_rows = window_rows;
+    options.overlap_rows = window_rows / 8;
+
+    int failed = 0;
+    for (std::size_t idx = 0; idx < files.size(); ++idx) {
+        cv::Mat image = cv::imread(files[idx], cv::IMREAD_COLOR);
+        if (image.empty()) {
+            std::cerr << "Could not decode " << files[idx] << std::endl;
+            ++failed;
+            continue;
+        }
+
+        recognizer::RowStream stream(
+                recognizer,
+                [&](const recognizer::RowStream::Line& line) {
+                    const cv::Rect& r = line.box;
+                    out << "{\"id\":" << idx
+                        << ",\"file\":\""
+                        << recognizer::Batch::json_escape(files[idx]) << '"'
+                        << ",\"box\":[" << r.x << ',' << r.y << ','
+                        << r.width << ',' << r.height << ']'
+                        << ",\"text\":\""
+                        << recognizer::Batch::json_escape(line.text) << '"';
+                    if (line.truncated) {
+                        out << ",\"truncated\":true";
+                    }
+                    out << '}' << std::endl;
+                },
+                options,
+                recognizer::RequestContext::timeout(settings.timeout));
+
+        // Bands are views of decoded image, stream copies what it keeps
+        for (int row = 0; row < image.rows; row += band_rows) {
+            stream.push(image.rowRange(row,
+                                       std::min(row + band_rows, image.rows)));
+        }
+        stream.finish();
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // Keep plain text output for a single image
+    if (argc == 2 && argv[1][0] != '-' && argv[1][0] != '@' &&
+        is_regular_file(argv[1])) {
+        return single_image(argv[1]);
+    }
+
+    static const struct option long_options[] = {
+        {"threads", required_argument, nullptr, 'N'},
+        {"jobs", required_argument, nullptr, 'j'},
+        {"read-ahead", required_argument, nullptr, 'r'},
+        {"io-depth", required_argument, nullptr, 'I'},
+        {"io-backend", required_argument, nullptr, 'G'},
+        {"no-map", no_argument, nullptr, 'M'},
+        {"decoders", required_argument, nullptr, 'd'},
+        {"decode-ahead", required_argument, nullptr, 'A'},
+        {"manifest", required_argument, nullptr, 'm'},
+        {"output", required_argument, nullptr, 'o'},
+        {"timeout", required_argument, nullptr, 't'},
+        {"max-in-flight", required_argument, nullptr, 'F'},
+        {"queue-target", required_argument, nullptr, 'Q'},
+        {"degrade", no_argument, nullptr, 'D'},
+        {"background", no_argument, nullptr, 'B'},
+        {"background-share", required_argument, nullptr, 'S'},
+        {"preset", required_argument, nullptr, 'p'},
+        {"degrade-preset", required_argument, nullptr, 'P'},
+        {"bench-presets", no_argument, nullptr, 'b'},
+        {"sort", optional_argument, nullptr, 'O'},
+        {"no-numa", no_argument, nullptr, 'U'},
+        {"scheduling", required_argument, nullptr, 'Y'},
+        {"bench-scheduling", no_argument, nullptr, 'y'},
+        {"watch-models", no_argument, nullptr, 'W'},
+        {"tessdata", required_argument, nullptr, 'T'},
+        {"prefork", required_argument, nullptr, 'X'},
+        {"no-coalesce", no_argument, nullptr, 'C'},
+        {"frames", required_argument, nullptr, 'R'},
+        {"frame-slots", required_argument, nullptr, 'e'},
+        {"frame-mb", required_argument, nullptr, 'E'},
+        {"frame-replace", no_argument, nullptr, 'V'},
+        {"publish", required_argument, nullptr, 'H'},
+        {"progressive", no_argument, nullptr, 'a'},
+        {"stream-rows", required_argument, nullptr, 'g'},
+        {"stream-window", required_argument, nullptr, 'w'},
+        {"soak", required_argument, nullptr, 'K'},
+        {"soak-tolerance", required_argument, nullptr, 'L'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}
+    };
+
+    Settings settings;
+    recognizer::Engine::Options& options = settings.options;
+    // Tool owns the process, library thread pools would only compete
+    // with engine threads
+    options.configure_libraries = true;
+    bool bench = false;
+    bool bench_policies = false;
+    double soak_seconds = 0.0;
+    double soak_tolerance = 10.0;
+    std::string frames;
+    std::size_t frame_slots = 8;
+    std::size_t frame_mb = 32;
+    bool frame_replace = false;
+    std::string publish;
+    int stream_rows = 0;
+    int stream_window = 2048;
+    std::string tessdata;
+    std::string output;
+    std::vector<std::string> specs;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "j:r:m:o:t:p:h",
+                              long_options, nullptr)) != -1) {
+        switch (opt) {
+        case 'N':
+            options.threads = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'j':
+            options.workers = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'r':
+            options.read_ahead = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'I':
+            options.io_depth = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'M':
+            options.map_raster = false;
+            break;
+        case 'd':
+            options.decoders = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'A':
+            options.decode_ahead = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'G':
+            if (!parse_backend(optarg, options.io_backend)) {
+                std::cerr << "Unknown read backend " << optarg << std::endl;
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'F':
+            options.max_in_flight = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'Q':
+            options.queue_delay_target_ms = std::strtod(optarg, nullptr);
+            break;
+        case 'D':
+            options.degrade = true;
+            break;
+        case 'B':
+            settings.priority = recognizer::Priority::background;
+            break;
+        case 'S':
+            options.background_share = std::strtod(optarg, nullptr);
+            break;
+        case 'm':
+            specs.push_back(std::string("@") + optarg);
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case 't':
+            settings.timeout = std::strtol(optarg, nullptr, 10);
+            break;
+        case 'p':
+        case 'P':
+            try {
+                (opt == 'p' ? options.config : options.degraded_config) =
+                        recognizer::Config::preset(optarg);
+            } catch (const recognizer::RecException& ex) {
+                std::cerr << ex.what() << std::endl;
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'b':
+            bench = true;
+            break;
+        case 'O':
+            settings.sort = true;
+            settings.sort_window = optarg ?
+                    std::strtoul(optarg, nullptr, 10) : 0;
+            break;
+        case 'U':
+            options.numa = false;
+            break;
+        case 'Y':
+            if (!parse_policy(optarg, options.scheduling)) {
+                std::cerr << "Unknown scheduling policy " << optarg
+                          << std::endl;
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'y':
+            bench_policies = true;
+            break;
+        case 'W':
+            options.watch_models = true;
+            break;
+        case 'T':
+            tessdata = optarg;
+            break;
+        case 'X':
+            settings.prefork = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'C':
+            options.coalesce = false;
+            break;
+        case 'R':
+            frames = optarg;
+            break;
+        case 'e':
+            frame_slots = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'E':
+            frame_mb = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'V':
+            frame_replace = true;
+            break;
+        case 'H':
+            publish = optarg;
+            break;
+        case 'a':
+            settings.progressive = true;
+            break;
+        case 'g':
+            stream_rows = std::atoi(optarg);
+            break;
+        case 'w':
+            stream_window = std::atoi(optarg);
+            break;
+        case 'K':
+            soak_seconds = std::strtod(optarg, nullptr);
+            break;
+        case 'L':
+            soak_tolerance = std::strtod(optarg, nullptr);
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    for (int idx = optind; idx < argc; ++idx) {
+        specs.push_back(argv[idx]);
+    }
+
+    options.config.tessdata_file = tessdata;
+    options.degraded_config.tessdata_file = tessdata;
+
+    recognizer::Batch::Files files;
+    try {
+        for (const std::string& spec : specs) {
+            recognizer::Batch::collect(spec, files);
+        }
+    } catch (const recognizer::RecException& ex) {
+        std::cerr << "Exception has been caught: "
+                  << ex.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try {
+        if (bench) {
+            return bench_presets(files, settings);
+        }
+
+        if (bench_policies) {
+            return bench_scheduling(files, settings);
+        }
+
+        if (soak_seconds > 0.0) {
+            return soak(files, settings, soak_seconds, soak_tolerance);
+        }
+
+        if (!publish.empty()) {
+            return publish_frames(publish, files);
+        }
+
+        std::ofstream out_file;
+        if (!output.empty()) {
+            out_file.open(output);
+            if (!out_file) {
+                std::cerr << "Could not open output file "
+                          << output << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+
+        if (stream_rows > 0) {
+            return stream_files(files, settings, stream_rows, stream_window,
+                                output.empty() ? std::cout : out_file);
+        }
+
+        if (!frames.empty()) {
+            return consume_frames(frames, frame_slots, frame_mb,
+                                  frame_replace, settings,
+                                  output.empty() ? &std::cout : &out_file);
+        }
+
+        Summary summary;
+        run_batch(files, settings,
+                  output.empty() ? &std::cout : &out_file, summary);
+        print_summary(summary);
+
+        return summary.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+    } catch (const recognizer::RecException& ex) {
+        std::cerr << "Exception has been caught: "
+                  << ex.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
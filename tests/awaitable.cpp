@@ -0,0 +1,141 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * @file awaitable.cpp
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing test of C++20 coroutine interface of engine.
+ */
+
+#include <cstdlib>
+#include <exception>
+#include <future>
+#include <iostream>
+#include <string>
+
+#include <opencv2/imgproc.hpp>
+
+#include "awaitable.h"
+
+namespace
+{
+
+/**
+ * Coroutine started at once and destroyed when it returns.
+ */
+struct Task {
+    struct promise_type {
+        Task get_return_object()
+        {
+            return Task();
+        }
+
+        std::suspend_never initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        std::suspend_never final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void return_void()
+        {}
+
+        void unhandled_exception()
+        {
+            std::terminate();
+        }
+    };
+};
+
+/**
+ * Await recognition of image and pass result or error to promise.
+ */
+Task recognize(recognizer::Engine& engine, cv::Mat image,
+               std::promise<recognizer::Recognizer::Result>& done)
+{
+    try {
+        done.set_value(co_await recognizer::recognize_async(engine, image));
+    } catch (const recognizer::RecException&) {
+        done.set_exception(std::current_exception());
+    }
+}
+
+/**
+ * Whether awaiting recognition of image throws RecException.
+ */
+bool fails(recognizer::Engine& engine, const cv::Mat& image)
+{
+    std::promise<recognizer::Recognizer::Result> done;
+    std::future<recognizer::Recognizer::Result> result = done.get_future();
+    recognize(engine, image, done);
+
+    try {
+        result.get();
+    } catch (const recognizer::RecException&) {
+        return true;
+    }
+
+    return false;
+}
+
+int fail(const std::string& message)
+{
+    std::cerr << "FAILED: " << message << std::endl;
+    return EXIT_FAILURE;
+}
+
+}
+
+int main()
+{
+    recognizer::Engine::Options options;
+    options.threads = 1;
+    options.workers = 1;
+
+    recognizer::Engine engine(options);
+
+    // Resumed from worker thread
+    cv::Mat image(200, 800, CV_8UC3, cv::Scalar(255, 255, 255));
+    cv::putText(image, "Coroutine test", cv::Point(20, 100),
+                cv::FONT_HERSHEY_SIMPLEX, 2.0, cv::Scalar(0, 0, 0), 4);
+    if (fails(engine, image)) {
+        return fail("recognition of text image failed");
+    }
+
+    // Resumed from calling thread inside await_suspend
+    cv::Mat gray(200, 200, CV_8UC1, cv::Scalar(255));
+    if (!fails(engine, gray)) {
+        return fail("gray image is recognized");
+    }
+
+    // Not suspended at all
+    engine.finish();
+    if (!fails(engine, image)) {
+        return fail("closed engine recognized image");
+    }
+
+    std::cout << "PASSED" << std::endl;
+
+    return EXIT_SUCCESS;
+}
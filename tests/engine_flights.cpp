@@ -0,0 +1,123 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * @file engine_flights.cpp
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing test of coalesced jobs whose leader expires.
+ */
+
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <vector>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "engine.h"
+
+namespace
+{
+
+/**
+ * White image with black text lines.
+ */
+cv::Mat text_image(int width, int height, int lines)
+{
+    cv::Mat image(height, width, CV_8UC3, cv::Scalar(255, 255, 255));
+    for (int line = 0; line < lines; ++line) {
+        cv::putText(image, "Recognizer flight test",
+                    cv::Point(20, 60 + line * 80),
+                    cv::FONT_HERSHEY_SIMPLEX, 1.5, cv::Scalar(0, 0, 0), 3);
+    }
+
+    return image;
+}
+
+int fail(const std::string& message)
+{
+    std::cerr << "FAILED: " << message << std::endl;
+    return EXIT_FAILURE;
+}
+
+}
+
+int main()
+{
+    recognizer::Engine::Options options;
+    options.threads = 1;
+    options.workers = 1;
+    options.decoders = 1;
+    options.read_ahead = 4;
+
+    recognizer::Engine engine(options);
+
+    std::vector<uchar> data;
+    cv::imencode(".png", text_image(800, 200, 2), data);
+
+    std::promise<recognizer::Engine::Outcome> leader_done;
+    std::promise<recognizer::Engine::Outcome> follower_done;
+
+    // Only worker is busy, so leader and follower meet in flight
+    recognizer::Engine::Job blocker(0, std::string());
+    blocker.image = text_image(3000, 3000, 30);
+    engine.get_text_async(std::move(blocker),
+                          recognizer::Engine::Callback());
+
+    recognizer::Engine::Job leader(1, std::string());
+    leader.data = data;
+    leader.context.token().cancel();
+    engine.get_text_async(std::move(leader),
+                          [&](const recognizer::Engine::Outcome& outcome) {
+                              leader_done.set_value(outcome);
+                          });
+
+    recognizer::Engine::Job follower(2, std::string());
+    follower.data = data;
+    engine.get_text_async(std::move(follower),
+                          [&](const recognizer::Engine::Outcome& outcome) {
+                              follower_done.set_value(outcome);
+                          });
+
+    recognizer::Engine::Outcome leader_outcome =
+            leader_done.get_future().get();
+    recognizer::Engine::Outcome follower_outcome =
+            follower_done.get_future().get();
+    engine.finish();
+
+    if (!leader_outcome.result.expired) {
+        return fail("cancelled leader is not expired");
+    }
+    if (engine.counters().coalesced != 1) {
+        return fail("follower has not been coalesced with leader");
+    }
+    if (!follower_outcome.error.empty()) {
+        return fail("live follower failed: " + follower_outcome.error);
+    }
+    if (follower_outcome.result.expired || follower_outcome.coalesced) {
+        return fail("live follower got result of expired leader");
+    }
+
+    std::cout << "PASSED" << std::endl;
+
+    return EXIT_SUCCESS;
+}
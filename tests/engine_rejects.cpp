@@ -0,0 +1,111 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * @file engine_rejects.cpp
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing test of jobs engine can't recognize.
+ */
+
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "engine.h"
+
+namespace
+{
+
+/**
+ * Whether future of job fails with RecException.
+ */
+bool fails(std::future<recognizer::Recognizer::Result> future)
+{
+    try {
+        future.get();
+    } catch (const recognizer::RecException&) {
+        return true;
+    }
+
+    return false;
+}
+
+int fail(const std::string& message)
+{
+    std::cerr << "FAILED: " << message << std::endl;
+    return EXIT_FAILURE;
+}
+
+}
+
+int main()
+{
+    recognizer::Engine::Options options;
+    options.threads = 1;
+    options.workers = 1;
+
+    recognizer::Engine engine(options);
+
+    cv::Mat gray(200, 200, CV_8UC1, cv::Scalar(255));
+    if (!fails(engine.get_text_async(gray))) {
+        return fail("gray image is accepted");
+    }
+
+    cv::Mat wide(200, 200, CV_16UC3, cv::Scalar(255, 255, 255));
+    recognizer::Engine::Job job(1, std::string());
+    job.image = wide;
+    if (engine.submit(job) != recognizer::Engine::Admission::rejected) {
+        return fail("16-bit image is accepted");
+    }
+
+    std::vector<uchar> garbage(64, 0xff);
+    if (!fails(engine.get_text_async(garbage))) {
+        return fail("undecodable data is recognized");
+    }
+
+    // Engine keeps working after errors
+    cv::Mat blank(200, 200, CV_8UC3, cv::Scalar(255, 255, 255));
+    try {
+        engine.get_text_async(blank).get();
+    } catch (const recognizer::RecException& ex) {
+        return fail(std::string("blank image failed: ") + ex.what());
+    }
+
+    engine.finish();
+
+    // Jobs of closed engine are neither counted nor kept in flight
+    recognizer::Engine::Counters before = engine.counters();
+    if (engine.submit(recognizer::Engine::Job(2, std::string())) !=
+        recognizer::Engine::Admission::closed) {
+        return fail("finished engine accepted job");
+    }
+    recognizer::Engine::Counters after = engine.counters();
+    if (after.accepted != before.accepted ||
+        after.degraded != before.degraded || after.in_flight) {
+        return fail("job of closed engine is counted");
+    }
+
+    std::cout << "PASSED" << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,113 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+
+/**
+ * @file rowstream_cut.cpp
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing test of row stream window cut.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "rowstream.h"
+
+namespace
+{
+
+int failures = 0;
+
+void expect(bool condition, const std::string& message)
+{
+    if (!condition) {
+        std::cerr << "FAILED: " << message << std::endl;
+        ++failures;
+    }
+}
+
+/**
+ * Whether no box crosses cut, so every box is kept whole.
+ */
+bool clean(const recognizer::Recognizer::BoxesGroups& boxes, int cut)
+{
+    for (const cv::Rect& box : boxes) {
+        if (box.y < cut && box.br().y > cut) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+}
+
+int main()
+{
+    using recognizer::RowStream;
+
+    // Window of 1000 rows with overlap of 200 rows, cut starts at 800
+    const int limit = 800;
+
+    // Box above limit overlaps box straddling it and comes first
+    recognizer::Recognizer::BoxesGroups boxes = {
+        cv::Rect(10, 100, 300, 50),
+        cv::Rect(10, 700, 300, 90),
+        cv::Rect(400, 780, 300, 70)
+    };
+    int cut = RowStream::cut_rows(boxes, limit);
+    expect(cut == 700, "overlapping boxes cut at " + std::to_string(cut));
+    expect(clean(boxes, cut), "box crosses cut in given order");
+
+    // Same boxes with straddling box first
+    std::swap(boxes[0], boxes[2]);
+    cut = RowStream::cut_rows(boxes, limit);
+    expect(cut == 700, "reordered boxes cut at " + std::to_string(cut));
+    expect(clean(boxes, cut), "box crosses cut in reversed order");
+
+    // Chain of boxes each overlapping the one below
+    boxes = {
+        cv::Rect(0, 500, 100, 120),
+        cv::Rect(0, 600, 100, 120),
+        cv::Rect(0, 700, 100, 120),
+        cv::Rect(0, 400, 100, 120)
+    };
+    cut = RowStream::cut_rows(boxes, limit);
+    expect(cut == 400, "chained boxes cut at " + std::to_string(cut));
+
+    // Boxes inside limit don't move it
+    boxes = { cv::Rect(0, 0, 100, 800), cv::Rect(0, 800, 100, 100) };
+    cut = RowStream::cut_rows(boxes, limit);
+    expect(cut == limit, "complete boxes cut at " + std::to_string(cut));
+
+    // Box from the top of window across limit forces cut
+    boxes = { cv::Rect(0, 0, 100, 900), cv::Rect(0, 100, 100, 50) };
+    cut = RowStream::cut_rows(boxes, limit);
+    expect(cut <= 0, "tall box cut at " + std::to_string(cut));
+
+    if (failures) {
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "PASSED" << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,180 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * @file watcher.cpp
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing model files watcher definition.
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "watcher.h"
+
+namespace recognizer
+{
+
+/**
+ * Start watching files.
+ */
+ModelWatcher::ModelWatcher(const std::vector<std::string>& files,
+                           Callback callback, int settle_ms)
+        REC_THROW(RecException)
+        : callback_(std::move(callback)),
+          settle_ms_(settle_ms),
+          watches_(),
+          inotify_fd_(-1),
+          stop_fd_(),
+          thread_()
+{
+    inotify_fd_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd_ < 0) {
+        throw RecException(std::string("could not initialize inotify: ") +
+                           std::strerror(errno));
+    }
+
+    if (::pipe(stop_fd_)) {
+        ::close(inotify_fd_);
+        throw RecException(std::string("could not create pipe: ") +
+                           std::strerror(errno));
+    }
+
+    for (const std::string& file : files) {
+        Watch watch;
+        std::string::size_type slash = file.rfind('/');
+        if (slash == std::string::npos) {
+            watch.dir = ".";
+            watch.name = file;
+        } else {
+            watch.dir = slash ? file.substr(0, slash) : "/";
+            watch.name = file.substr(slash + 1);
+        }
+
+        // Watch directory, deploys usually replace files by rename
+        watch.wd = ::inotify_add_watch(inotify_fd_, watch.dir.c_str(),
+                                       IN_CLOSE_WRITE | IN_MOVED_TO |
+                                       IN_CREATE);
+        if (watch.wd < 0) {
+            int err = errno;
+            ::close(inotify_fd_);
+            ::close(stop_fd_[0]);
+            ::close(stop_fd_[1]);
+            throw RecException("could not watch " + watch.dir + ": " +
+                               std::strerror(err));
+        }
+
+        watches_.push_back(watch);
+    }
+
+    thread_ = std::thread(&ModelWatcher::watch_loop, this);
+}
+
+/**
+ * Stop watcher thread.
+ */
+ModelWatcher::~ModelWatcher()
+{
+    char stop = 0;
+    while (::write(stop_fd_[1], &stop, 1) < 0 && errno == EINTR) {
+    }
+
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+
+    ::close(inotify_fd_);
+    ::close(stop_fd_[0]);
+    ::close(stop_fd_[1]);
+}
+
+/**
+ * Check whether inotify event belongs to watched file.
+ */
+bool
+ModelWatcher::watched(int wd, const char* name) const
+{
+    for (const Watch& watch : watches_) {
+        if (watch.wd == wd && watch.name == name) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Wait for events and call back after quiet period.
+ */
+void
+ModelWatcher::watch_loop()
+{
+    alignas(struct inotify_event) char buf[4096];
+    bool pending = false;
+
+    for (;;) {
+        struct pollfd fds[2];
+        fds[0].fd = inotify_fd_;
+        fds[0].events = POLLIN;
+        fds[1].fd = stop_fd_[0];
+        fds[1].events = POLLIN;
+
+        int rc = ::poll(fds, 2, pending ? settle_ms_ : -1);
+        if (rc < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+
+        if (fds[1].revents) {
+            return;
+        }
+
+        // Quiet period passed after changes
+        if (!rc) {
+            pending = false;
+            callback_();
+            continue;
+        }
+
+        ssize_t len;
+        while ((len = ::read(inotify_fd_, buf, sizeof(buf))) > 0) {
+            for (char* ptr = buf; ptr < buf + len; ) {
+                const struct inotify_event* event =
+                        static_cast<const struct inotify_event*>(
+                            static_cast<void*>(ptr));
+
+                if (event->len && watched(event->wd, event->name)) {
+                    pending = true;
+                }
+
+                ptr += sizeof(struct inotify_event) + event->len;
+            }
+        }
+    }
+}
+
+}
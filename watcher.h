@@ -0,0 +1,101 @@
+/*
+Copyright (c) 2014 Alexander Bezsilko <demonsboots@gmail.com>
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+/**
+ * @file watcher.h
+ * @author Alexander Bezsilko
+ * @date 4 Nov 2014
+ * @brief File containing model files watcher declaration.
+ */
+
+#ifndef WATCHER_H_
+#define WATCHER_H_
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <functional>
+
+#include "recexcept.h"
+
+namespace recognizer
+{
+
+/**
+ * @brief Class ModelWatcher calls back when watched files change.
+ *
+ * @detailed Watcher uses inotify on directories containing the files,
+ * so files replaced by rename are noticed as well as files rewritten
+ * in place. Burst of events is collapsed: callback is called once
+ * after files stay quiet for the settle period.
+ */
+
+class ModelWatcher {
+public:
+    typedef std::function<void()> Callback;
+
+    /**
+     * @brief Start watching files.
+     *
+     * @param[in] files Files to watch.
+     * @param[in] callback Called from watcher thread after changes.
+     * @param[in] settle_ms Quiet period before callback.
+     * @throw RecException if inotify could not be initialized.
+     */
+    ModelWatcher(const std::vector<std::string>& files, Callback callback,
+                 int settle_ms = 500) REC_THROW(RecException);
+
+    ModelWatcher(const ModelWatcher&) = delete;
+    ModelWatcher& operator=(const ModelWatcher&) = delete;
+
+    /**
+     * @brief Stop watcher thread.
+     */
+    ~ModelWatcher();
+
+private:
+
+    /**
+     * @brief Watched file split to directory and name.
+     */
+    struct Watch {
+        int wd = -1;
+        std::string dir{};
+        std::string name{};
+    };
+
+    void watch_loop();
+
+    /**
+     * @brief Check whether inotify event belongs to watched file.
+     */
+    bool watched(int wd, const char* name) const;
+
+private:
+    Callback callback_;
+    const int settle_ms_;
+    std::vector<Watch> watches_;
+    int inotify_fd_;
+    int stop_fd_[2];
+    std::thread thread_;
+};
+
+}
+
+#endif // WATCHER_H_